@@ -43,7 +43,15 @@ function print_remove( row )
   name = row["name"];
   name = name.replace( /\"/g, "&quote;" );
   name = name.replace( /'/g, "&quote;" );
-  return "<a href=\"javascript: remove( " + row["id"] + ", '" + name + "' );\">X</a>";
+  r = "";
+  if( row["state"] == 4 || row["state"] == 5 ) // done or aborted
+    r += "<a href=\"javascript: convert( " + row["id"] + " );\" title=\"convert to MKV\">MKV</a> ";
+  return r + "<a href=\"javascript: remove( " + row["id"] + ", '" + name + "' );\">X</a>";
+}
+
+function convert( id )
+{
+  getJSON( 'tvd?c=recorder&a=convert&id=' + id, rethandler );
 }
 
 function remove( id, name )
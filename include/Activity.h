@@ -23,6 +23,7 @@
 #define _Activity_
 
 #include "Thread.h"
+#include "TSMonitor.h"
 
 #include <string>
 
@@ -71,6 +72,8 @@ class Activity : public Thread
 
     time_t GetStateChanged( ) const { return state_changed; }
 
+    const TSMonitor &GetMonitor( ) const { return monitor; }
+
     bool Start( );
     virtual void Stop( ) { up = false; }
     void Abort( );
@@ -79,6 +82,8 @@ class Activity : public Thread
     virtual std::string GetTitle( ) const = 0;
     virtual bool Perform( ) = 0;
     virtual void Failed( ) = 0;
+    // read EIT passively while tuned, see EITCollector
+    virtual bool CollectEPG( ) const { return false; }
 
     void Run( );
 
@@ -88,7 +93,7 @@ class Activity : public Thread
     Transponder *transponder;
     Frontend *frontend;
     Port *port;
-
+    TSMonitor monitor;
 
   private:
     State state;
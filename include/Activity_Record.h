@@ -25,6 +25,7 @@
 #include "Activity.h"
 #include "ConfigObject.h"
 #include "RPCObject.h"
+#include "StreamFilter.h"
 
 class Event;
 class Recorder;
@@ -41,6 +42,7 @@ class Activity_Record : public Activity, public ConfigObject, public JSONObject
     virtual bool LoadConfig( );
 
     virtual std::string GetTitle( ) const;
+    virtual bool CollectEPG( ) const { return true; }
     std::string GetName( ) const;
     const std::string &GetFilename( ) const;
 
@@ -48,6 +50,8 @@ class Activity_Record : public Activity, public ConfigObject, public JSONObject
     time_t GetEnd( )     const { return end; }
     int    GetEventID( ) const { return event_id; }
 
+    StreamFilter &GetStreamFilter( ) { return filter; }
+
     static bool SortByStart( const Activity_Record *a, const Activity_Record *b );
 
     // RPC
@@ -61,6 +65,7 @@ class Activity_Record : public Activity, public ConfigObject, public JSONObject
     int event_id;
     std::string name;
     std::string filename;
+    StreamFilter filter;
 
     virtual bool Perform( );
     virtual void Failed( ) { }
@@ -24,6 +24,10 @@
 
 #include "Activity.h"
 
+#include <stdint.h>
+
+struct dvb_table_pmt;
+
 class Activity_Scan : public Activity
 {
   public:
@@ -34,7 +38,9 @@ class Activity_Scan : public Activity
 
   private:
     virtual bool Perform( );
-    virtual void Failed( ) { };
+    virtual void Failed( );
+
+    void ReadPMT( uint16_t service_id, struct dvb_table_pmt *pmt );
 };
 
 
@@ -41,6 +41,7 @@ class Activity_Stream : public Activity
     virtual ~Activity_Stream( );
 
     virtual std::string GetTitle( ) const;
+    virtual bool CollectEPG( ) const { return true; }
     virtual void Stop( );
 
     double GetDuration( );
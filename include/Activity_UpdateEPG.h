@@ -24,6 +24,8 @@
 
 #include "Activity.h"
 
+#define EPG_UPDATE_MAX 60 // seconds
+
 class Activity_UpdateEPG : public Activity
 {
   public:
@@ -27,9 +27,14 @@
 #include "Event.h"
 #include "Utils.h" // Name
 #include "Thread.h" // Name
+#include "StreamFilter.h"
 
 #include <string>
 #include <vector>
+#include <unordered_map>
+
+#define EPG_FILE_MAGIC   0x47504554 // "TEPG"
+#define EPG_FILE_VERSION 2
 
 class TVDaemon;
 class Service;
@@ -48,6 +53,10 @@ class Channel : public ConfigObject, public RPCObject
 
     virtual bool SaveConfig( );
     virtual bool LoadConfig( );
+    virtual bool RemoveConfigFile( );
+
+    bool SaveEPG( );
+    bool LoadEPG( );
 
     bool AddService( Service *service );
     bool HasService( Service *service ) const;
@@ -57,10 +66,14 @@ class Channel : public ConfigObject, public RPCObject
 
     // RPC
     void json( json_object *entry ) const;
+    void serialize( JSONWriter &writer ) const;
     bool RPC( const HTTPRequest &request, const std::string &cat, const std::string &action );
     virtual bool compare( const JSONObject &other, const int &p ) const;
 
     bool Tune( Activity &act );
+    int GetPopularity( ) const { return popularity; } // times tuned
+
+    StreamFilter &GetStreamFilter( ) { return filter; }
 
     bool epg;
 
@@ -75,18 +88,27 @@ class Channel : public ConfigObject, public RPCObject
     void UpdateEPG( );
 
     void ClearEPG( );
-    bool AddEPGEvent( const struct dvb_table_eit_event *event );
+    bool AddEPGEvent( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version );
+    void ExpireEPG( time_t before );
+    std::string GetEPGFile( ) const { return GetConfigDir( ) + "epg"; }
 
   private:
     TVDaemon &tvd;
     Name name;
     int number;
+    int popularity;
     State state;
 
     std::vector<Service *> services;
 
     std::vector<Event *> events;
+    std::unordered_map<uint16_t, Event *> event_index; // by event id
+    void InsertEvent( Event *event );
+    bool epg_modified; // since the last SaveEPG( )
     Mutex mutex;
+    Mutex save_mutex; // one SaveEPG( ) at a time, they share the temp file
+
+    StreamFilter filter;
 };
 
 #endif
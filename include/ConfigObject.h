@@ -60,7 +60,7 @@ class ConfigBase
     void     WriteConfig ( const char *key, uint32_t u32 );
     void     WriteConfig ( const char *key, time_t t );
     void     WriteConfig ( const char *key, float f );
-    void     WriteConfig ( const char *key, std::string &s );
+    void     WriteConfig ( const char *key, const std::string &s );
     bool     DeleteConfig( const char *key );
   protected:
     Setting *settings;
@@ -345,7 +345,7 @@ class ConfigObject : public ConfigBase
     bool SetConfigFile( std::string configfile );
     bool WriteConfigFile( );
     bool ReadConfigFile( );
-    bool RemoveConfigFile( );
+    virtual bool RemoveConfigFile( );
 
     std::list<int> GetParentPath( );
 
@@ -0,0 +1,60 @@
+/*
+ *  tvdaemon
+ *
+ *  EITCollector class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EITCollector_
+#define _EITCollector_
+
+#include "Thread.h"
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define EIT_COLLECTOR_SAVE 60 // seconds between writing collected events
+
+class Frontend;
+class Transponder;
+
+// Reads the EIT sections of the transponder a frontend is tuned to while
+// an activity is using it, so its EPG stays current without an update.
+class EITCollector : public Thread
+{
+  public:
+    EITCollector( Frontend &frontend, Transponder &transponder );
+    virtual ~EITCollector( );
+
+    bool Start( );
+    void Stop( );
+
+  private:
+    virtual void Run( );
+    void Process( const uint8_t *data, ssize_t len );
+    void Save( );
+
+    Frontend &frontend;
+    Transponder &transponder;
+    int fd;
+    bool up;
+    int events;
+    time_t last_save;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ *  tvdaemon
+ *
+ *  EITSectionCache class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EITSectionCache_
+#define _EITSectionCache_
+
+#include "Thread.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <unordered_map>
+
+// Remembers version and CRC of the EIT sections seen on a transponder, so
+// repeats of the carousel can be dropped before they are parsed.
+class EITSectionCache : public Mutex
+{
+  public:
+    // false if the section was seen before with the same version and CRC
+    bool Changed( const uint8_t *section, ssize_t len );
+    void Clear( );
+
+  private:
+    // key: table_id, service_id, section_number; value: version, CRC
+    std::unordered_map<uint32_t, uint64_t> sections;
+};
+
+#endif
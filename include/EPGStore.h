@@ -0,0 +1,139 @@
+/*
+ *  tvdaemon
+ *
+ *  EPGStore class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EPGStore_
+#define _EPGStore_
+
+#include "Thread.h"
+#include "RPCObject.h"
+
+#include <time.h>
+#include <stdint.h>
+#include <set>
+#include <map>
+#include <vector>
+#include <string>
+
+#define EPG_MIN_WORD 2 // shorter words are only found as prefix of longer ones
+
+class Event;
+class Channel;
+struct dvb_table_eit_event;
+
+// Index over the EPG events of all channels. Events are kept ordered by
+// (start, channel) for the guide, and by start per channel, so time window
+// and now/next lookups do not have to walk the complete EPG. The words of
+// title, descriptions and channel name go into an inverted index for search.
+class EPGStore : public Mutex
+{
+  public:
+    EPGStore( );
+    virtual ~EPGStore( );
+
+    void Add( Event *event );
+    void Remove( Event *event );
+    void Remove( const Channel &channel );
+    // applies a newer version of the EIT sub-table carrying the event
+    void Update( Event *event, const struct dvb_table_eit_event *data, uint8_t table_id, uint8_t version );
+
+    // events overlapping [from, to), ordered by start and channel
+    void Get( time_t from, time_t to, std::vector<Event *> &result ) const;
+    void Get( const Channel &channel, time_t from, time_t to, std::vector<Event *> &result ) const;
+
+    int GetCount( ) const;
+
+  private:
+    struct Key
+    {
+      Key( time_t start, Event *event ) : start(start), event(event) { }
+      time_t start;
+      Event *event; // NULL sorts before all events starting at the same time
+      bool operator<( const Key &other ) const;
+    };
+
+    typedef std::multimap<time_t, Event *> ChannelIndex;
+
+  public:
+    // pages through Get( ) without copying the result, keeps the store
+    // locked while it exists
+    class Cursor : public JSONCursor
+    {
+      public:
+        Cursor( const EPGStore &store, const Channel *channel, time_t from, time_t to );
+        virtual const JSONObject *Next( );
+        virtual int Count( ) const { return count; }
+
+      private:
+        ScopeLock lock;
+        time_t from, to;
+        const ChannelIndex *index;
+        std::set<Key>::const_iterator it, end;
+        ChannelIndex::const_iterator it2;
+        int count;
+    };
+
+    // now/next and search results, keeps the store locked while it exists
+    // so the events cannot expire before they are serialized
+    class Result : public JSONCursor
+    {
+      public:
+        Result( const EPGStore &store );
+        // the running and the following event of every channel, optionally
+        // only those matching text
+        void NowNext( time_t now, const Channel *channel, const std::string &text );
+        // events containing words starting with each word of text
+        void Search( const std::string &text, const Channel *channel, time_t from, time_t to );
+
+        virtual const JSONObject *Next( );
+        virtual int Count( ) const { return events.size( ); }
+
+      private:
+        ScopeLock lock;
+        const EPGStore &store;
+        std::vector<Event *> events;
+        size_t i;
+    };
+
+  private:
+    bool Insert( Event *event );
+    bool Erase( Event *event );
+
+    static bool Sort( const Event *a, const Event *b );
+    static ChannelIndex::const_iterator First( const ChannelIndex &index, time_t from );
+    static int CountWindow( const ChannelIndex &index, time_t from, time_t to );
+
+    typedef std::vector<Event *> Postings; // sorted by pointer
+    static void Tokenize( const std::string &text, std::set<std::string> &tokens, size_t min_length = EPG_MIN_WORD );
+    static void Tokenize( const Event *event, std::set<std::string> &tokens );
+    void IndexWords( Event *event );
+    void UnindexWords( Event *event );
+    void Lookup( const std::string &text, Postings &matches ) const;
+
+    void GetNowNext( time_t now, std::vector<Event *> &result ) const;
+    void Search( const std::string &text, const Channel *channel, time_t from, time_t to, std::vector<Event *> &result ) const;
+
+    std::set<Key> events;
+    std::map<const Channel *, ChannelIndex> channels;
+    std::map<std::string, Postings> words;
+    uint32_t max_duration;
+};
+
+#endif
@@ -23,14 +23,15 @@
 #define _Event_
 
 #include "RPCObject.h"
-#include "Utils.h" // Name
+#include "StringPool.h"
 
 #include <time.h>
 #include <stdint.h>
 #include <string>
-#include <map>
 #include <vector>
 
+#define EVENT_VERSION_UNKNOWN 0xff // EIT versions are 5 bit
+
 struct dvb_table_eit_event;
 class ConfigBase;
 class Channel;
@@ -39,22 +40,33 @@ class Event : public RPCObject
 {
   public:
     Event( Channel &channel );
-    Event( Channel &channel, const struct dvb_table_eit_event *event );
+    Event( Channel &channel, const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version );
     virtual ~Event( );
 
     bool SaveConfig( ConfigBase &config );
     bool LoadConfig( ConfigBase &config );
 
+    // binary record for the EPG file, see Channel::SaveEPG
+    void Pack( std::string &buffer ) const;
+    bool Unpack( const uint8_t *&data, const uint8_t *end );
+
+    void Update( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version );
+    static time_t GetStart( const struct dvb_table_eit_event *event );
+
     int GetID( )                  { return id; }
-    const Name &GetName( ) const  { return name; }
-    const Name &GetDescription( ) const { return description; }
+    const std::string &GetName( ) const { return name; }
+    const std::string &GetDescription( ) const { return description; }
+    const std::string &GetDescriptionExtended( ) const { return description_extended; }
     Channel &GetChannel( )        { return channel; }
     time_t GetStart( ) const;
     time_t GetEnd( ) const;
-    uint32_t GetDuration( )       { return duration; }
+    uint32_t GetDuration( ) const { return duration; }
+    // whether the event was already read from this version of the EIT sub-table
+    bool IsCurrent( uint8_t table_id, uint8_t version ) const;
 
     // RPC
     virtual void json( json_object *j ) const;
+    virtual void serialize( JSONWriter &writer ) const;
     virtual bool RPC( const HTTPRequest &request, const std::string &cat, const std::string &action ) { return false; }
     virtual bool compare( const JSONObject &other, const int &p ) const;
 
@@ -63,11 +75,20 @@ class Event : public RPCObject
     int id;
     time_t start;
     uint32_t duration; // seconds
-    Name name;
-    Name description;
-    std::string language;
-    std::string description_extended;
-    std::map<std::string, std::vector<std::string>> description_items;
+    // versions of the EIT the event was read from. present/following and
+    // every schedule table are versioned independently, the schedule table
+    // of an event shifts as the days pass.
+    uint8_t version_pf;
+    uint8_t version_schedule;
+    uint8_t schedule_table_id;
+    InternedString name;
+    InternedString description;
+    InternedString language;
+    InternedString description_extended;
+    // (item description, item), sorted by item description
+    typedef std::pair<InternedString, InternedString> DescriptionItem;
+    std::vector<DescriptionItem> description_items;
+    static bool CompareItems( const DescriptionItem &a, const DescriptionItem &b );
 
   friend bool operator<( const Event &a, const Event &b );
 };
@@ -26,6 +26,7 @@
 #include "RPCObject.h"
 #include "Source.h"
 #include "Thread.h"
+#include "TSMonitor.h"
 
 #include <string>
 #include <vector>
@@ -39,6 +40,9 @@ class Port;
 class Activity;
 
 #define DMX_BUFSIZE 2 * 1024 * 1024
+#define BLIND_SCAN_CARRIER_TIMEOUT 500 // ms to wait for a carrier on a probe
+#define FE_POLL_MIN 5   // ms, lock polling right after a status change
+#define FE_POLL_MAX 100 // ms, lock polling while nothing changes
 
 class Frontend : public ConfigObject, public RPCObject, public Thread
 {
@@ -66,10 +70,13 @@ class Frontend : public ConfigObject, public RPCObject, public Thread
 
     struct dvb_v5_fe_parms *GetFE( ) { return fe; }
     static bool GetInfo( int adapter_id, int frontend_id, fe_delivery_system_t *delsys, std::string *name = NULL );
-    virtual bool GetLockStatus( uint8_t &signal, uint8_t &noise, int timeout /* miliseconds */ );
+    // carrier_timeout: give up early if there is no carrier at all
+    virtual bool GetLockStatus( uint8_t &signal, uint8_t &noise, int timeout /* miliseconds */, int carrier_timeout = 0 );
     int OpenDemux( );
     void CloseDemux( int fd );
 
+    TSMonitor &GetMonitor( ) { return monitor; }
+
     virtual bool SaveConfig( );
     virtual bool LoadConfig( );
 
@@ -130,11 +137,15 @@ class Frontend : public ConfigObject, public RPCObject, public Thread
     int tune_timeout;
     bool up;
 
+    TSMonitor monitor;
+
   private:
     bool SetPort( int port_id );
+    bool ReadStatus( uint32_t &status );
 
     State state;
     int usecount;
+    int fd_status; // read only, for cheap FE_READ_STATUS while tuning
 
     std::map<uint16_t, uint16_t> pid_map;
     std::deque<uint16_t> pno_list;
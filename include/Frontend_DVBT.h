@@ -37,6 +37,9 @@ class Frontend_DVBT : public Frontend
     virtual bool LoadConfig( );
 
     virtual bool HandleNIT( struct dvb_table_nit *nit );
+
+  private:
+    static fe_code_rate CodeRate( uint8_t code_rate );
 };
 
 #endif
@@ -9,6 +9,7 @@
 #define _HTTPServer_
 
 #include "SocketHandler.h"
+#include "Thread.h"
 
 #include <map>
 #include <string>
@@ -17,10 +18,17 @@
 #include <stdint.h>
 #include <netinet/in.h> // sockaddr_in
 
-#define HTTP_VERSION  "HTTP/1.0"
+#define HTTP_VERSION  "HTTP/1.1"
 #define RTSP_VERSION  "RTSP/1.0"
 
+#define HTTP_CACHE_FILE_MAX  ( 256 * 1024 )       // larger files are sent with sendfile( )
+#define HTTP_CACHE_MAX       ( 16 * 1024 * 1024 )
+#define HTTP_COMPRESS_MIN    1024 // smaller responses are not worth compressing
+#define HTTP_KEEPALIVE_TIMEOUT  15 // seconds an idle persistent connection is kept
+#define HTTP_MAX_CONNECTIONS   256
+
 struct json_object;
+struct stat;
 
 typedef enum
 {
@@ -40,6 +48,7 @@ typedef enum
 {
   HTTP_OK                  = 200,
   HTTP_REDIRECT            = 300,
+  HTTP_NOT_MODIFIED        = 304,
   HTTP_BAD_REQUEST         = 400,
   HTTP_UNAUTHORIZED        = 401,
   HTTP_FORBIDDEN           = 403,
@@ -80,6 +89,10 @@ class HTTPServer : public SocketHandler
     void SetRTSPHandler( RTSPHandler *handler );
 
     std::string GetRoot( ) { return _root; }
+    void PreloadFiles( );
+
+    static bool Compress( const std::string &data, std::string &compressed );
+    static bool IsCompressible( const std::string &extension );
 
     static void URLEncode( const std::string &string, std::string &encoded );
     static void URLDecode( const std::string &string, std::string &decoded );
@@ -95,14 +108,19 @@ class HTTPServer : public SocketHandler
         void AddTimeStamp( );
         void AddMime( const char *mime );
         void AddHeader( const char *header, const char *fmt, ... ) __attribute__ (( format( printf, 3, 4 )));
-        void AddContent( std::string buffer );
+        void AddContent( const std::string &buffer );
+        void AddContentLength( size_t length );
 
         void Finalize( );
 
         void FreeResponseBuffer( );
-        std::string GetBuffer( ) const;
+        const std::string &GetBuffer( ) const;
+        const std::string &GetContent( ) const { return _content; }
       private:
-        std::string _buffer;
+        std::string _buffer; // status line and headers
+        std::string _content;
+        ssize_t content_length;
+        bool has_body;
         bool header_closed;
     };
 
@@ -141,6 +159,25 @@ class HTTPServer : public SocketHandler
 
     bool HandleRequest( HTTPRequest &request );
 
+    // static files up to HTTP_CACHE_FILE_MAX, validated by mtime and size,
+    // with a gzip variant for compressible types
+    struct CachedFile
+    {
+      std::string content;
+      std::string gzip;
+      time_t mtime;
+      off_t size;
+    };
+    std::map<std::string, CachedFile> file_cache;
+    size_t file_cache_size;
+    Mutex file_cache_mutex;
+
+    bool ServeFile( HTTPRequest &request, const std::string &filename );
+    bool ReadFile( const std::string &filename, const struct stat &st, std::string &content );
+    bool LoadFile( const std::string &filename, const struct stat &st, CachedFile &file );
+    void StoreFile( const std::string &filename, CachedFile &file );
+    int PreloadDir( const std::string &dir );
+
     // Handle HTTP methods
     bool GET( HTTPRequest &request );
     bool POST( HTTPRequest &request );
@@ -174,6 +211,7 @@ class HTTPRequest
     HTTPRequest( HTTPServer &server, int client );
 
     bool HasHeader( const char *key ) const;
+    bool AcceptsGzip( ) const;
     bool GetHeader( const char *key, std::string &value ) const;
     bool GetHeader( const char *key, int &value ) const;
 
@@ -182,13 +220,17 @@ class HTTPRequest
     bool GetParam( const char *key, int &value ) const;
 
     void Reply( HTTPServer::Response &response ) const;
+    bool ReplyFile( HTTPServer::Response &response, int fd, size_t size ) const;
     void Reply( json_object *obj ) const;
+    void ReplyJSON( const std::string &json ) const;
     void Reply( HTTPStatus status ) const;
     void Reply( HTTPStatus status, int ret ) const;
     void NotFound( const char *fmt, ... ) const __attribute__ (( format( printf, 2, 3 )));
 
     void KeepAlive( bool b ) { keep_alive = b; }
     bool KeepAlive( ) const { return keep_alive; }
+    // a complete response was sent, errors included
+    bool Replied( ) const { return replied; }
 
     std::string GetDocRoot( ) const { return server.GetRoot( ); }
 
@@ -210,6 +252,7 @@ class HTTPRequest
     std::string content;
     std::map<std::string, std::string> parameters;
     bool keep_alive;
+    mutable bool replied;
     struct sockaddr_in client_addr;
 
   friend class HTTPServer;
@@ -0,0 +1,61 @@
+/*
+ *  tvdaemon
+ *
+ *  JSONWriter class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _JSONWriter_
+#define _JSONWriter_
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include <json-c/json.h>
+
+// Serializes JSON directly into a string, for large responses where
+// building a json-c tree first would cost an allocation per value.
+// A NULL key adds an array element.
+class JSONWriter
+{
+  public:
+    JSONWriter( std::string &out );
+
+    void BeginObject( const char *key = NULL );
+    void EndObject( );
+    void BeginArray( const char *key = NULL );
+    void EndArray( );
+
+    void Add( const char *key, int value );
+    void Add( const char *key, long long value );
+    void Add( const char *key, double value );
+    void Add( const char *key, const char *value );
+    void Add( const char *key, const std::string &value );
+    void AddBool( const char *key, bool value );
+    void AddTime( const char *key, time_t value ); // as json_object_time_add
+    void AddRaw( const char *key, json_object *value );
+
+  private:
+    void Key( const char *key );
+    void String( const char *value, size_t length );
+
+    std::string &out;
+    std::vector<bool> first; // per nesting level: no element written yet
+    struct tm today, tomorrow;
+};
+
+#endif
@@ -22,16 +22,21 @@
 #ifndef _Matroska_
 #define _Matroska_
 
-#include <ebml/StdIOCallback.h>
+#include <ebml/IOCallback.h>
 #include <ebml/EbmlHead.h>
 #include <ebml/EbmlVoid.h>
 #include <matroska/KaxSegment.h>
 #include <matroska/KaxSeekHead.h>
 #include "matroska/KaxCues.h"
 #include "matroska/KaxCluster.h"
+#include "matroska/KaxBlock.h"
 
 #include <libdvbv5/mpeg_es.h>
 
+#include <vector>
+
+#include "Thread.h"
+
 using namespace LIBEBML_NAMESPACE;
 using namespace LIBMATROSKA_NAMESPACE;
 
@@ -40,24 +45,96 @@ template<typename A, typename B> B &GetChildAs( EbmlMaster &m )
   return GetChild<A>( m );
 }
 
+// IOCallback writing through a large userspace buffer, so that the many
+// small element renders of libebml end up in few write( ) syscalls.
+class MatroskaIOCallback : public IOCallback
+{
+  public:
+    MatroskaIOCallback( const std::string &filename, size_t buffer_size );
+    virtual ~MatroskaIOCallback( );
+
+    virtual uint32 read( void *data, size_t size );
+    virtual void setFilePointer( int64 offset, seek_mode mode = seek_beginning );
+    virtual size_t write( const void *data, size_t size );
+    virtual uint64 getFilePointer( );
+    virtual void close( );
+
+  private:
+    void WriteAll( const binary *data, size_t size );
+    void Flush( );
+
+    int fd;
+    binary *buffer;
+    size_t buffer_size;
+    size_t buffer_fill;
+    uint64 position;
+};
+
+// Recycles frame payload buffers in power of two size classes.
+class MatroskaFramePool
+{
+  public:
+    MatroskaFramePool( size_t max_free );
+    ~MatroskaFramePool( );
+
+    binary *Alloc( size_t size );
+    void Free( binary *data, size_t size );
+
+  private:
+    static int GetClass( size_t size );
+
+    Mutex mutex;
+    size_t max_free;
+    std::vector<std::vector<binary *> > free_buffers;
+};
+
+// DataBuffer with its payload from a MatroskaFramePool. libmatroska
+// deletes frames in KaxInternalBlock::ReleaseFrames, so the objects
+// themselves are recycled through the class operator new/delete.
+class MatroskaFrame : public DataBuffer
+{
+  public:
+    MatroskaFrame( MatroskaFramePool &pool, const uint8_t *data, size_t size );
+    virtual ~MatroskaFrame( );
+
+    static void *operator new( size_t size );
+    static void operator delete( void *p );
+
+  private:
+    static bool Release( const DataBuffer &buffer );
+
+    MatroskaFramePool &pool;
+
+    static Mutex free_mutex;
+    static std::vector<void *> free_frames;
+};
+
 class Matroska
 {
   public:
-    Matroska( const std::string& name );
+    Matroska( const std::string &filename );
     ~Matroska( );
 
-    void WriteHeader( );
-    void AddTrack( );
+    bool WriteHeader( const std::string &title );
+    bool OpenChunk( );
+    int  AddVideoTrack( const char *codec, int width, int height, int display_width, int display_height, int display_unit = 0 );
+    int  AddAudioTrack( const char *codec, double sampling_frequency, int channels );
+    void SetCodecPrivate( int track, const uint8_t *data, size_t size );
     void AddCluster( uint64_t ts );
     void CloseCluster( );
     void WriteSegment( );
-    void AddFrame( uint64_t ts, dvb_mpeg_es_frame_t type, uint8_t *data, size_t size );
+    bool AddFrame( int track, uint64_t ts, dvb_mpeg_es_frame_t type, const uint8_t *data, size_t size );
+    bool AppendChunk( const std::string &filename );
 
   private:
-    std::string name;
+    KaxTrackEntry &AddTrack( int type, const char *codec );
+    void WriteTracks( );
+
+    std::string filename;
     uint64_t timecode_scale;
 
-    StdIOCallback *out;
+    MatroskaIOCallback *out;
+    MatroskaFramePool pool;
     EbmlHead header;
     KaxSegment segment;
     EbmlVoid dummy;
@@ -65,13 +142,14 @@ class Matroska
     KaxCues cues;
     KaxCluster *cluster;
 
-    KaxTrackEntry *track;
+    std::vector<KaxTrackEntry *> tracks;
+    int video_track;
+    bool chunk;
+    bool tracks_written;
 
     uint64_t segment_size;
     uint64_t curr_seg_size;
 
-    int track_count;
-
     uint64_t cluster_size;
 
 };
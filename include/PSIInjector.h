@@ -0,0 +1,63 @@
+/*
+ *  tvdaemon
+ *
+ *  PSIInjector class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PSIInjector_
+#define _PSIInjector_
+
+#include <stdint.h>
+#include <unistd.h> // ssize_t
+#include <time.h>
+#include <vector>
+#include <map>
+
+#define PSI_INTERVAL 500 // ms
+
+struct dvb_v5_fe_parms;
+struct dvb_table_sdt;
+struct dvb_table_pat;
+struct dvb_table_pmt;
+
+// Holds the synthesized SDT, PAT and PMT as ready to send TS packets and
+// repeats them every interval, so clients can join an output mid-stream.
+class PSIInjector
+{
+  public:
+    PSIInjector( int interval = PSI_INTERVAL );
+    ~PSIInjector( );
+
+    bool AddSDT( struct dvb_v5_fe_parms *fe, struct dvb_table_sdt *sdt );
+    bool AddPAT( struct dvb_v5_fe_parms *fe, struct dvb_table_pat *pat );
+    bool AddPMT( struct dvb_v5_fe_parms *fe, struct dvb_table_pmt *pmt, uint16_t pid );
+
+    bool Due( );
+    const uint8_t *GetPackets( size_t &size );
+
+  private:
+    bool AddSection( struct dvb_v5_fe_parms *fe, uint8_t *section, ssize_t size, uint16_t pid );
+
+    int interval;
+    struct timespec last;
+    bool sent;
+    std::vector<uint8_t> packets;
+    std::map<uint16_t, uint8_t> counters;
+};
+
+#endif
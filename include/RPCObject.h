@@ -26,16 +26,30 @@
 #include <map>
 #include <json-c/json.h>
 
+#include "JSONWriter.h"
+
 class HTTPRequest;
 
 class JSONObject
 {
   public:
     virtual void json( json_object *j ) const = 0;
+    // writes the members of json( ), for large lists
+    virtual void serialize( JSONWriter &writer ) const;
 
     virtual bool compare( const JSONObject &other, const int &p ) const = 0;
 };
 
+// walks an already ordered collection, returns NULL past the end
+class JSONCursor
+{
+  public:
+    virtual ~JSONCursor( ) { }
+    virtual const JSONObject *Next( ) = 0;
+    // number of rows, -1 if it has to be counted by walking them
+    virtual int Count( ) const { return -1; }
+};
+
 void json_object_time_add( json_object *j, std::string name, time_t tt );
 void json_object_object_add( json_object *j, int key, json_object *k );
 
@@ -25,6 +25,8 @@
 //#include <stdint.h> // uint64_t
 
 #include <map>
+#include <list>
+#include <vector>
 
 #include "Thread.h"
 #include "ConfigObject.h"
@@ -40,6 +42,7 @@ class Channel;
 class Event;
 class TVDaemon;
 class JSONObject;
+class Remux;
 
 class Recorder : public Thread, public ConfigObject, public RPCHandler
 {
@@ -54,13 +57,26 @@ class Recorder : public Thread, public ConfigObject, public RPCHandler
     void Record( Channel &channel );
     void Stop( );
     bool Remove( int id );
+    bool Convert( int id );
 
     std::string GetDir( ) const { return dir; }
+    int GetPSIInterval( ) const { return psi_interval; }
 
     //void AddTrack( );
     //void record( uint8_t *data, int size );
 
-    void GetRecordings( std::vector<const JSONObject *> &result ) const;
+    // the recordings, keeps the recorder locked while it exists so they
+    // cannot be removed before they are serialized
+    class Recordings
+    {
+      public:
+        Recordings( const Recorder &recorder );
+        std::vector<const JSONObject *> data;
+
+      private:
+        ScopeLock lock;
+    };
+
     Activity_Record *GetRecording( int id );
 
     bool RPC( const HTTPRequest &request, const std::string &cat, const std::string &action );
@@ -75,6 +91,12 @@ class Recorder : public Thread, public ConfigObject, public RPCHandler
     bool up;
     std::string dir;
     std::map<int, Activity_Record *> recordings;
+    std::list<int> conversions;
+    Remux *remux;
+    int convert_threads;
+    int psi_interval;
+
+    void HandleConversions( );
 
     virtual void Run( );
 };
@@ -0,0 +1,146 @@
+/*
+ *  tvdaemon
+ *
+ *  Remux class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Remux_
+#define _Remux_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <sys/types.h> // off_t
+
+#include "Thread.h"
+
+class Matroska;
+
+// Converts a recorded MPEG-TS file to Matroska. The file is split on
+// video keyframes into chunks which are muxed in parallel and then
+// concatenated in order.
+class Remux : public Thread
+{
+  public:
+    Remux( const std::string &input, const std::string &output, const std::string &title, int workers = 0 );
+    virtual ~Remux( );
+
+    bool Start( );
+    void Abort( ) { up = false; }
+    bool IsDone( ) const { return done; }
+    bool Succeeded( ) const { return success; }
+
+    const std::string &GetInput( ) const { return input; }
+    const std::string &GetOutput( ) const { return output; }
+
+    bool Convert( );
+
+  private:
+    struct Track
+    {
+      uint16_t pid;
+      int stream_type;
+      bool video;
+      bool h264;
+      bool probed;
+      int width, height;
+      int display_width, display_height, display_unit;
+      const char *codec;
+      int sampling_frequency;
+      int channels;
+      std::vector<uint8_t> codec_private;
+    };
+
+    class Demux
+    {
+      public:
+        Demux( Remux &remux );
+        virtual ~Demux( );
+
+        bool Process( off_t begin, off_t end );
+
+      protected:
+        virtual bool HandlePES( Track &track, off_t offset, const uint8_t *data, size_t size ) = 0;
+
+        Remux &remux;
+
+      private:
+        struct Pending
+        {
+          Pending( ) : offset(-1) { }
+          off_t offset;
+          std::vector<uint8_t> data;
+        };
+        std::map<uint16_t, Pending> pending;
+    };
+
+    class Prober : public Demux
+    {
+      public:
+        Prober( Remux &remux ) : Demux( remux ), keyframe(-1), probe_all(true) { }
+        off_t keyframe;
+        uint64_t keyframe_pts;
+        bool probe_all;
+
+      private:
+        virtual bool HandlePES( Track &track, off_t offset, const uint8_t *data, size_t size );
+    };
+
+    class Worker : public Thread, public Demux
+    {
+      public:
+        Worker( Remux &remux, int id, off_t begin, off_t end );
+        virtual ~Worker( );
+
+        bool Start( ) { return StartThread( ); }
+        void Join( ) { JoinThread( ); }
+        bool Succeeded( ) const { return success; }
+        const std::string &GetFilename( ) const { return filename; }
+
+      private:
+        virtual void Run( );
+        virtual bool HandlePES( Track &track, off_t offset, const uint8_t *data, size_t size );
+
+        off_t begin, end;
+        std::string filename;
+        Matroska *mkv;
+        std::map<uint16_t, uint64_t> last_ts;
+        std::vector<uint8_t> buffer;
+        bool success;
+    };
+
+    bool ReadPMT( );
+    bool Probe( );
+    off_t FindKeyframe( off_t from );
+    void AddTracks( Matroska &mkv, bool codec_private );
+    bool GetTimecode( uint64_t pts, uint64_t &ts ) const;
+
+    virtual void Run( );
+
+    std::string input, output, title;
+    int workers;
+    int fd;
+    off_t size;
+    std::vector<Track> tracks;
+    std::map<uint16_t, int> track_index;
+    uint64_t base_pts;
+    bool up, done, success;
+};
+
+#endif
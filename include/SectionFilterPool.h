@@ -0,0 +1,66 @@
+/*
+ *  tvdaemon
+ *
+ *  SectionFilterPool class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SectionFilterPool_
+#define _SectionFilterPool_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <map>
+
+#define SECTION_FILTER_POOL_MAX 16 // demux filters are a scarce resource
+
+class Frontend;
+
+// A set of demux section filters of one frontend, waited on with a single
+// epoll, so tables on many PIDs are captured within one carousel cycle.
+class SectionFilterPool
+{
+  public:
+    SectionFilterPool( Frontend &frontend, int max = SECTION_FILTER_POOL_MAX );
+    ~SectionFilterPool( );
+
+    // table_id -1 passes all tables of the pid; returns the filter
+    // handle, -1 if the pool is full or on error
+    int Add( uint16_t pid, int table_id = -1 );
+    void Remove( int filter );
+    void Clear( );
+
+    int GetCount( ) const { return filters.size( ); }
+    bool IsFull( ) const { return (int) filters.size( ) >= max; }
+    uint16_t GetPID( int filter ) const;
+
+    // reads the next section of any filter into data and sets filter;
+    // returns the length, 0 on timeout (ms) and -1 on error
+    ssize_t Read( int &filter, uint8_t *data, size_t size, int timeout );
+
+  private:
+    Frontend &frontend;
+    int max;
+    int epoll_fd;
+    std::map<int, uint16_t> filters; // demux fd, pid
+
+    struct epoll_event events[SECTION_FILTER_POOL_MAX];
+    int ready, next;
+};
+
+#endif
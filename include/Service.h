@@ -73,7 +73,7 @@ class Service : public RPCObject
     Transponder &GetTransponder( ) const { return transponder; }
 
 
-    bool UpdateStream( int pid, Stream::Type type );
+    bool UpdateStream( int pid, Stream::Type type, const std::string &language );
     std::map<uint16_t, Stream *> &GetStreams();
 
     bool SaveConfig( ConfigBase &config );
@@ -83,12 +83,14 @@ class Service : public RPCObject
 
     // RPC
     void json( json_object *entry ) const;
+    void serialize( JSONWriter &writer ) const;
     bool RPC( const HTTPRequest &request, const std::string &cat, const std::string &action );
     virtual bool compare( const JSONObject &other, const int &p ) const;
 
     bool Tune( Activity &act );
 
-    bool ReadEPG( const struct dvb_table_eit_event *event );
+    int  AddEPG( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version );
+    void SaveEPG( );
 
   private:
     Transponder &transponder;
@@ -9,11 +9,20 @@
 #define _SocketHandler_
 
 #include <sys/socket.h> // fd_set
+#include <netinet/in.h> // sockaddr_in
 #include <pthread.h>
 #include <string>
 #include <map>
+#include <deque>
+#include <vector>
 #include <stdarg.h>     // va_list, va_start, va_end
 #include <syslog.h>
+#include <time.h>
+
+#define SOCKETHANDLER_WORKERS 4
+#define RXBUF_SIZE  4096       // initial receive buffer per connection
+#define RXBUF_MAX   ( 64 * 1024 ) // longest line accepted
+#define RXBUF_POOL  64         // idle buffers kept for reuse
 
 typedef void (*shlog)( int level, const char *fmt, ... );
 
@@ -41,6 +50,15 @@ class SocketHandler
     pthread_t handler;
     mutable pthread_mutex_t mutex;
 
+    // server: epoll event loop dispatching readable clients to workers
+    int epfd;
+    int num_workers;
+    int max_clients;
+    int idle_timeout;
+    std::vector<pthread_t> workers;
+    std::deque<int> queue;
+    pthread_cond_t queue_cond;
+
     enum SocketType
     {
       UNIX,
@@ -63,6 +81,12 @@ class SocketHandler
     bool Connect( );
 
     static void *run( void *ptr );
+    static void *work( void *ptr );
+
+    void RunServer( );
+    void ExpireClients( );
+    void RunClient( );
+    void Work( );
 
   public:
     virtual ~SocketHandler( );
@@ -74,8 +98,15 @@ class SocketHandler
     bool Start( );
     void Stop ( );
 
+    void SetWorkers( int n ) { num_workers = n > 0 ? n : 1; } // before Start( )
+    void SetMaxClients( int n ) { max_clients = n; } // 0: unlimited
+    void SetIdleTimeout( int seconds ) { idle_timeout = seconds; } // for new clients, 0: none
+    void SetClientTimeout( int client, int seconds );
+
     virtual bool Send( const char *buffer, int len );
     virtual bool SendToClient( int client, const char *buffer, int len );
+    bool SendToClient( int client, const char *header, int header_len, const char *content, int content_len );
+    bool SendFileToClient( int client, int fd, off_t offset, size_t len );
     bool GetClientAddress( int client, struct sockaddr_in &addr ) const;
     bool GetServerAddress( int client, struct sockaddr_in &addr ) const;
 
@@ -119,8 +150,33 @@ class SocketHandler
     virtual void HandleMessage( const int client, const Message &msg ) = 0;
 
   private:
-    std::map<int, Message *> messages;
-    std::map<int, struct sockaddr_in> clients;
+    // receive buffer of a connection, taken from the pool while data is pending
+    struct Buffer
+    {
+      char *data;
+      int size;
+      int used;
+    };
+
+    struct Client
+    {
+      struct sockaddr_in addr;
+      Message *message;
+      Buffer rx;
+      time_t last_active;
+      int timeout;
+      bool busy; // queued or handled by a worker
+      bool closing;
+      bool error;
+    };
+    std::map<int, Client *> clients;
+    std::vector<char *> buffer_pool;
+
+    int Fill( int fd, Buffer &rx );
+    bool Receive( int fd, Message *&message, Buffer &rx, const Client *client );
+    void ReleaseBuffer( Buffer &rx );
+    void HandleClient( int fd );
+    void CloseClient( int fd, Client *client );
 
     shlog logfunc;
 
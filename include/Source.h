@@ -29,6 +29,8 @@
 #include <string>
 #include <vector>
 
+#define BLIND_SCAN_SYMBOL_RATE 6900000 // common for DVB-C
+
 class Port;
 class Channel;
 class HTTPServer;
@@ -72,6 +74,9 @@ class Source : public ConfigObject, public RPCObject, public Mutex
     bool GetNextEPGUpdate( time_t &next );
 
     void Scan( );
+    // adds probe transponders from..to (Hz) for DVB-T/C, returns their count.
+    // a bandwidth of 0 lets the frontend detect it
+    int BlindScan( uint32_t from, uint32_t to, uint32_t step, uint32_t bandwidth = 0, uint32_t symbol_rate = BLIND_SCAN_SYMBOL_RATE );
 
     int CountServices( ) const;
 
@@ -80,7 +85,11 @@ class Source : public ConfigObject, public RPCObject, public Mutex
     bool AddPort( Port *port );
     bool RemovePort( Port *port );
     void RemoveChannel( Channel *channel );
-    bool AddTransponder( Transponder *t );
+    // a free transponder id. probes get removed, so the count is no id;
+    // keep the source locked until the transponder is added
+    int GetAvailableTransponderKey( );
+    bool AddTransponder( Transponder *t ); // source locked
+    void RemoveTransponder( Transponder *t );
 
     // RPC
     void json( json_object *entry ) const;
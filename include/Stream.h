@@ -62,7 +62,7 @@ class Stream : public Thread
       _end_audio_types
     };
 
-    Stream( Service &service, uint16_t id, enum Type type, int config_id );
+    Stream( Service &service, uint16_t id, enum Type type, const std::string &language, int config_id );
     Stream( Service &service );
     virtual ~Stream( );
 
@@ -71,8 +71,9 @@ class Stream : public Thread
 
     virtual int GetKey( ) const { return id; }
 
-    bool Update( Type type );
+    bool Update( Type type, const std::string &language );
     Type GetType( ) { return type; }
+    const std::string &GetLanguage( ) const { return language; }
     int GetTypeMPEG( );
     const char *GetTypeName( ) { return GetTypeName( type ); };
     bool IsVideo( ) { return type > _start_video_types && type < _start_audio_types; }
@@ -90,6 +91,7 @@ class Stream : public Thread
     Service &service;
     uint16_t id;
     Type type;
+    std::string language;
 
     //AVFormatContext *ifc;
     //AVIOContext *ictx;
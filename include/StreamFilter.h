@@ -0,0 +1,64 @@
+/*
+ *  tvdaemon
+ *
+ *  StreamFilter class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _StreamFilter_
+#define _StreamFilter_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <json-c/json.h>
+
+class Stream;
+class JSONWriter;
+class ConfigBase;
+class HTTPRequest;
+
+// Selects the streams of a service to record: optionally only the first
+// video stream and only audio streams in the given languages.
+class StreamFilter
+{
+  public:
+    StreamFilter( );
+    ~StreamFilter( );
+
+    bool IsEmpty( ) const { return !first_video_only && audio_languages.empty( ); }
+
+    void SetFirstVideoOnly( bool first_video_only ) { this->first_video_only = first_video_only; }
+    void SetAudioLanguages( const std::string &languages );
+    std::string GetAudioLanguages( ) const;
+
+    void Apply( std::map<uint16_t, Stream *> &streams, std::vector<Stream *> &result ) const;
+
+    bool SaveConfig( ConfigBase &config );
+    bool LoadConfig( ConfigBase &config );
+
+    void json( json_object *entry ) const;
+    void serialize( JSONWriter &writer ) const;
+    void Set( const HTTPRequest &request );
+
+  private:
+    bool first_video_only;
+    std::vector<std::string> audio_languages;
+};
+
+#endif
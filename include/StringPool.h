@@ -0,0 +1,81 @@
+/*
+ *  tvdaemon
+ *
+ *  StringPool class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _StringPool_
+#define _StringPool_
+
+#include "Thread.h"
+
+#include <string>
+#include <unordered_map>
+#include <utility> // swap
+
+// Reference counted pool of immutable strings. The EPG repeats titles,
+// languages and item keys a lot, events only keep a pointer into the pool.
+class StringPool : public Mutex
+{
+  public:
+    typedef std::unordered_map<std::string, unsigned int>::value_type Entry;
+
+    static StringPool &Instance( );
+
+    Entry *Get( const std::string &s );
+    void Ref( Entry *entry );
+    void Unref( Entry *entry );
+
+  private:
+    StringPool( ) { }
+
+    std::unordered_map<std::string, unsigned int> strings;
+};
+
+// A string held in the StringPool, the size of a pointer
+class InternedString
+{
+  public:
+    InternedString( ) : entry(NULL) { }
+    InternedString( const std::string &s );
+    InternedString( const char *s );
+    InternedString( const InternedString &other );
+    // moves do not touch the pool, so growing and sorting vectors of
+    // interned strings does not take its lock
+    InternedString( InternedString &&other ) noexcept : entry(other.entry) { other.entry = NULL; }
+    ~InternedString( );
+
+    InternedString &operator=( const InternedString &other );
+    InternedString &operator=( InternedString &&other ) noexcept { std::swap( entry, other.entry ); return *this; }
+    InternedString &operator=( const std::string &s );
+    InternedString &operator=( const char *s ) { return *this = std::string( s ); }
+
+    const std::string &str( ) const { return entry ? entry->first : none; }
+    operator const std::string &( ) const { return str( ); }
+    const char *c_str( ) const { return str( ).c_str( ); }
+    bool empty( ) const { return entry == NULL; }
+
+    bool operator==( const InternedString &other ) const { return entry == other.entry; }
+    bool operator<( const InternedString &other ) const { return str( ) < other.str( ); }
+
+  private:
+    StringPool::Entry *entry;
+    static const std::string none;
+};
+
+#endif
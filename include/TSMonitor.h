@@ -0,0 +1,65 @@
+/*
+ *  tvdaemon
+ *
+ *  TSMonitor class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TSMonitor_
+#define _TSMonitor_
+
+#include "Thread.h"
+
+#include <stdint.h>
+#include <time.h>
+#include <json-c/json.h>
+
+// Checks the TS packets of a capture for continuity counter gaps, transport
+// errors and packets left scrambled, and counts demux buffer overflows.
+// Counters are optionally added to a parent, i.e. the frontend's totals.
+class TSMonitor : public Mutex
+{
+  public:
+    TSMonitor( );
+    virtual ~TSMonitor( );
+
+    void Reset( TSMonitor *parent = NULL );
+    void Process( const uint8_t *data, size_t len );
+    void Overflow( );
+
+    void json( json_object *j ) const;
+
+  private:
+    struct Counters
+    {
+      uint64_t packets;
+      uint64_t sync_errors;
+      uint64_t cc_errors;
+      uint64_t tei_errors;
+      uint64_t scrambled;
+      uint64_t overflows;
+    };
+
+    void Add( const Counters &delta );
+
+    TSMonitor *parent;
+    Counters counters;
+    time_t since;
+    uint8_t cc[8192]; // last continuity counter per pid, 0xFF = unknown
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include "HTTPServer.h"
 #include "Thread.h"
 #include "Source.h"
+#include "EPGStore.h"
 
 #include <map>
 #include <vector>
@@ -82,12 +83,13 @@ class TVDaemon : public ConfigObject, public HTTPDynamicHandler, public RTSPHand
     bool RPC_Source ( const HTTPRequest &request, const std::string &cat, const std::string &action );
     bool RPC_Adapter( const HTTPRequest &request, const std::string &cat, const std::string &action );
 
-    void ServerSideTable( const HTTPRequest &request, std::vector<const JSONObject *> &data ) const;
+    void ServerSideTable( const HTTPRequest &request, std::vector<const JSONObject *> &data, bool sorted = false ) const;
 
     bool Schedule( Event &event );
     void Record( Channel &channel );
     void UpdateEPG( );
     int GetEPGUpdateInterval( ) const { return epg_update_interval; }
+    EPGStore &GetEPGStore( ) { return epg_store; }
 
     void ProcessAdapters( );
     void AddFrontendToList( const std::string& adapter_name, const std::string& frontend_name, const std::string& uid, const int adapter_id, const int frontend_id);
@@ -99,6 +101,9 @@ class TVDaemon : public ConfigObject, public HTTPDynamicHandler, public RTSPHand
     TVDaemon( );
     void FindAdapters( );
     void MonitorAdapters( );
+    static void GetPage( const HTTPRequest &request, int &start, int &page_size );
+    static void WriteTable( const HTTPRequest &request, JSONCursor &cursor, std::string &json );
+    static void WriteTable( const HTTPRequest &request, std::vector<const JSONObject *> &data, std::string &json, bool sorted = false );
 
     static TVDaemon *instance;
     int epg_update_interval;
@@ -128,6 +133,7 @@ class TVDaemon : public ConfigObject, public HTTPDynamicHandler, public RTSPHand
     void HandleUdev( );
 
     std::vector<Transponder *> epg_transponders;
+    EPGStore epg_store;
 
     Avahi_Client *avahi_client;
 
@@ -25,14 +25,17 @@
 #include "ConfigObject.h"
 #include "RPCObject.h"
 #include "Service.h"
+#include "EITSectionCache.h"
 
 #include <set>
+#include <vector>
 #include <utility>
 
 #include <libdvbv5/dvb-frontend.h>
 
 class Source;
 class Activity;
+class Port;
 struct PAT;
 
 class Transponder : public ConfigObject, public RPCObject
@@ -62,6 +65,12 @@ class Transponder : public ConfigObject, public RPCObject
 
     virtual bool GetParams( struct dvb_v5_fe_parms *params ) const;
 
+    // exact parameters of the last lock on a port, to tune without AUTO.
+    // applied on top of GetParams( )
+    bool ApplyTuneCache( const Port *port, struct dvb_v5_fe_parms *params ) const;
+    void UpdateTuneCache( const Port *port, struct dvb_v5_fe_parms *params );
+    void ClearTuneCache( );
+
     virtual std::string toString( ) const = 0;
 
     fe_delivery_system_t GetDelSys( ) const { return delsys; }
@@ -69,7 +78,7 @@ class Transponder : public ConfigObject, public RPCObject
 
     bool UpdateProgram( uint16_t service_id, uint16_t pid );
     bool UpdateService( uint16_t service_id, Service::Type type, std::string name, std::string provider );
-    bool UpdateStream( uint16_t pid, int id, int type );
+    bool UpdateStream( uint16_t pid, int id, int type, const std::string &language );
 
     Service *CreateService( std::string  name );
 
@@ -90,6 +99,10 @@ class Transponder : public ConfigObject, public RPCObject
     bool Enabled( ) { return enabled; }
     bool Disabled( ) { return !enabled; }
 
+    // created by a blind scan, dropped if it does not lock
+    void SetProbe( bool probe ) { this->probe = probe; }
+    bool IsProbe( ) const { return probe; }
+
     enum State
     {
       State_New,
@@ -102,6 +115,7 @@ class Transponder : public ConfigObject, public RPCObject
       State_ScanningFailed,
       State_Idle,
       State_Duplicate,
+      State_NoSignal, // tuned but no lock
       State_Last
     };
 
@@ -121,11 +135,16 @@ class Transponder : public ConfigObject, public RPCObject
 
     static const char *GetStateName( State state );
     bool HasChannels( ) const { return has_channels; }
+    int GetPopularity( ) const;
+    // an EITCollector is reading the EPG, locked by the source
+    void SetCollecting( bool collecting );
+    bool IsCollecting( ) const { return collectors > 0; }
     void HasChannels( bool b ) { has_channels = b; }
     void RemoveChannel( Channel *channel );
 
     // RPC
     void json( json_object *entry ) const;
+    void serialize( JSONWriter &writer ) const;
     bool RPC( const HTTPRequest &request, const std::string &cat, const std::string &action );
     virtual bool compare( const JSONObject &other, const int &p ) const;
 
@@ -134,10 +153,14 @@ class Transponder : public ConfigObject, public RPCObject
     void UpdateEPG( );
     time_t LastEPGUpdate( ) const { return last_epg_update; }
     time_t LastEPGFailed( ) const { return last_epg_failed; }
-    bool ReadEPG( const struct dvb_table_eit_event *event );
+    // returns the new or changed events, -1 for a known or foreign section
+    int  AddEITSection( struct dvb_v5_fe_parms *fe, const uint8_t *data, ssize_t len );
+    int  AddEPG( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version );
+    void SaveEPG( );
 
   protected:
     bool enabled;
+    bool probe;
     uint8_t signal;
     uint8_t noise;
     Source &source;
@@ -161,6 +184,10 @@ class Transponder : public ConfigObject, public RPCObject
     EPGState epg_state;
     time_t last_epg_update;
     time_t last_epg_failed;
+    EITSectionCache eit_cache;
+    int collectors;
+    const Port *tune_cache_port;
+    std::vector<std::pair<uint32_t, uint32_t> > tune_cache; // DTV_* command, value
     bool has_channels;
 
 };
@@ -29,6 +29,17 @@ class Transponder_DVBT : public Transponder
   public:
     Transponder_DVBT( Source &src, const fe_delivery_system_t delsys, int config_id );
     Transponder_DVBT( Source &src, std::string configfile );
+    Transponder_DVBT( Source &source,
+                      const fe_delivery_system_t delsys,
+                      uint32_t frequency,
+                      int bandwidth,
+                      fe_code_rate code_rate_HP,
+                      fe_code_rate code_rate_LP,
+                      fe_modulation modulation,
+                      fe_transmit_mode transmission_mode,
+                      fe_guard_interval guard_interval,
+                      fe_hierarchy hierarchy,
+                      int config_id );
     virtual ~Transponder_DVBT( );
 
     virtual bool SaveConfig( );
@@ -24,6 +24,7 @@
 #include "Frontend.h"
 #include "Channel.h"
 #include "TVDaemon.h"
+#include "EITCollector.h"
 
 #include <unistd.h> // NULL
 
@@ -47,6 +48,7 @@ bool Activity::Start( )
 void Activity::Run( )
 {
   bool ret;
+  EITCollector *eit = NULL;
   std::string name = GetTitle( );
   state = State_Running;
   state_changed = time( NULL );
@@ -72,7 +74,19 @@ void Activity::Run( )
     TVDaemon::Instance( )->UnlockFrontends( );
   }
 
+  if( frontend )
+    monitor.Reset( &frontend->GetMonitor( ));
+  if( frontend and transponder and CollectEPG( ))
+  {
+    eit = new EITCollector( *frontend, *transponder );
+    if( !eit->Start( ))
+    {
+      delete eit;
+      eit = NULL;
+    }
+  }
   ret = Perform( );
+  delete eit;
 
   if( frontend )
     frontend->Release( );
@@ -30,6 +30,7 @@
 #include "Recorder.h"
 #include "RPCObject.h"
 #include "CAMClient.h"
+#include "PSIInjector.h"
 
 #include <libdvbv5/pat.h>
 #include <libdvbv5/eit.h>
@@ -116,6 +117,7 @@ bool Activity_Record::SaveConfig( )
   WriteConfig( "Duration", duration );
   WriteConfig( "EventID",  event_id );
   WriteConfig( "Filename", filename );
+  filter.SaveConfig( *this );
 
   return WriteConfigFile( );
 }
@@ -135,6 +137,7 @@ bool Activity_Record::LoadConfig( )
   ReadConfig( "Duration", duration );
   ReadConfig( "EventID",  event_id );
   ReadConfig( "Filename", filename );
+  filter.LoadConfig( *this );
 
   if( HasState( State_Running ))
     SetState( State_Missed );
@@ -240,31 +243,31 @@ bool Activity_Record::Perform( )
     //return -1;
   //}
 
-  std::map<uint16_t, Stream *> &streams = service->GetStreams( );
-  for( std::map<uint16_t, Stream *>::iterator it = streams.begin( ); it != streams.end( ); it++)
-  {
-    if( it->second->IsVideo( ) || it->second->IsAudio( ))
-    {
-      frontend->Log( "Adding Stream %d: %s", it->first, it->second->GetTypeName( ));
-      int fd = service->Open( *frontend, it->second->GetKey( ));
-      if( fd > 0 )
-        fds.push_back( fd );
-      else
-        LogError( "Error opening demux" );
+  // the recording's own rules take precedence over the channel's
+  std::vector<Stream *> streams;
+  if( !filter.IsEmpty( ))
+    filter.Apply( service->GetStreams( ), streams );
+  else
+    channel->GetStreamFilter( ).Apply( service->GetStreams( ), streams );
 
-      struct dvb_table_pmt_stream *stream = dvb_table_pmt_stream_create( pmt, it->second->GetKey( ), it->second->GetTypeMPEG( ));
+  for( std::vector<Stream *>::iterator it = streams.begin( ); it != streams.end( ); it++)
+  {
+    frontend->Log( "Adding Stream %d: %s %s", (*it)->GetKey( ), (*it)->GetTypeName( ), (*it)->GetLanguage( ).c_str( ));
+    int fd = service->Open( *frontend, (*it)->GetKey( ));
+    if( fd > 0 )
+      fds.push_back( fd );
+    else
+      LogError( "Error opening demux" );
 
-      if( it->second->IsVideo( ))
-      {
-        pmt->pcr_pid = it->second->GetKey( );
-      ////rec.AddTrack( );
-      //videofd = fd;
-      //
-      }
+    struct dvb_table_pmt_stream *stream = dvb_table_pmt_stream_create( pmt, (*it)->GetKey( ), (*it)->GetTypeMPEG( ));
 
+    if( (*it)->IsVideo( ))
+    {
+      pmt->pcr_pid = (*it)->GetKey( );
+    ////rec.AddTrack( );
+    //videofd = fd;
+    //
     }
-    else
-      frontend->LogWarn( "Ignoring Stream %d: %s (%d)", it->first, it->second->GetTypeName( ), it->second->GetType( ));
   }
 
   if( fds.empty( ))
@@ -274,6 +277,22 @@ bool Activity_Record::Perform( )
     return false;
   }
 
+  // the tables are repeated in the output, see PSIInjector
+  PSIInjector psi( recorder.GetPSIInterval( ));
+  bool psi_ok = psi.AddSDT( frontend->GetFE( ), sdt ) &&
+                psi.AddPAT( frontend->GetFE( ), pat ) &&
+                psi.AddPMT( frontend->GetFE( ), pmt, 0x1000 );
+  dvb_table_sdt_free( sdt );
+  dvb_table_pat_free( pat );
+  dvb_table_pmt_free( pmt );
+  if( !psi_ok )
+  {
+    frontend->LogError( "cannot create PSI tables" );
+    for( std::vector<int>::iterator it = fds.begin( ); it != fds.end( ); it++ )
+      frontend->CloseDemux( *it );
+    return false;
+  }
+
   std::string upcoming;
 
   bool started = false;
@@ -359,51 +378,6 @@ bool Activity_Record::Perform( )
 
   frontend->Log( "Recording '%s' ...", filename.c_str( ));
 
-  {
-    /* SDT */
-    uint8_t *data;
-    ssize_t size = dvb_table_sdt_store( frontend->GetFE( ), sdt, &data );
-    dvb_table_sdt_free( sdt );
-    if( !data )
-    {
-      frontend->LogError( "cannot store" );
-      return -2;
-    }
-
-    uint8_t *mpegts;
-    size = dvb_mpeg_ts_create( frontend->GetFE( ), data, size, &mpegts, DVB_TABLE_SDT_PID, 0 );
-    free( data );
-    int r = write( file_fd, mpegts, size );
-    free( mpegts );
-
-    /* PAT */
-    size = dvb_table_pat_store( frontend->GetFE( ), pat, &data );
-    dvb_table_pat_free( pat );
-    if( !data )
-    {
-      frontend->LogError( "cannot store" );
-      return -2;
-    }
-
-    size = dvb_mpeg_ts_create( frontend->GetFE( ), data, size, &mpegts, DVB_TABLE_PAT_PID, 0 );
-    free( data );
-    r = write( file_fd, mpegts, size );
-    free( mpegts );
-
-    /* PMT */
-    size = dvb_table_pmt_store( frontend->GetFE( ), pmt, &data );
-    dvb_table_pmt_free( pmt );
-    if( !data )
-    {
-      frontend->LogError( "cannot store" );
-      return -2;
-    }
-
-    size = dvb_mpeg_ts_create( frontend->GetFE( ), data, size, &mpegts, 0x1000, 0 );
-    free( data );
-    r = write( file_fd, mpegts, size );
-    free( mpegts );
-  }
 
 
   fd_set tmp_fdset;
@@ -500,7 +474,13 @@ bool Activity_Record::Perform( )
         len = read( fd, data, DMX_BUFSIZE );
         if( len < 0 )
         {
-          frontend->LogError( "Error receiving data... %d", errno );
+          if( errno == EOVERFLOW )
+          {
+            frontend->LogWarn( "Demux buffer overflow, data lost" );
+            monitor.Overflow( );
+          }
+          else
+            frontend->LogError( "Error receiving data... %d", errno );
           continue;
         }
 
@@ -510,6 +490,18 @@ bool Activity_Record::Perform( )
           continue;
         }
 
+        if( psi.Due( ))
+        {
+          size_t size;
+          const uint8_t *tables = psi.GetPackets( size );
+          if( write( file_fd, tables, size ) != (ssize_t) size )
+          {
+            LogError( "Error writing to %s", filename.c_str( ));
+            Stop( );
+            break;
+          }
+        }
+
         int remaining = len;
         uint8_t *p = data;
         while( IsActive( ) && remaining > 0 )
@@ -531,6 +523,7 @@ bool Activity_Record::Perform( )
 
           p += chunk;
         }
+        monitor.Process( data, p - data );
 
 
         //if( fd == videofd )
@@ -603,6 +596,11 @@ void Activity_Record::json( json_object *j ) const
   json_object_object_add( j, "state",   json_object_new_int( GetState( )));
   if( channel )
     json_object_object_add( j, "channel", json_object_new_string( channel->GetName( ).c_str( )));
+  filter.json( j );
+
+  json_object *ts = json_object_new_object( );
+  monitor.json( ts );
+  json_object_object_add( j, "ts", ts );
 }
 
 bool Activity_Record::compare( const JSONObject &other, const int &p ) const
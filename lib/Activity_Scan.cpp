@@ -22,7 +22,9 @@
 #include "Activity_Scan.h"
 #include "Log.h"
 #include "Transponder.h"
+#include "Source.h"
 #include "Frontend.h"
+#include "SectionFilterPool.h"
 
 #include <time.h>
 #include <libdvbv5/dvb-fe.h> // FIXME: remove
@@ -41,9 +43,45 @@
 #include <libdvbv5/desc_event_short.h>
 #include <libdvbv5/desc_hierarchy.h>
 #include <libdvbv5/desc_ca.h>
+#include <libdvbv5/desc_language.h>
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
 
 
+// reads one table on its own demux, so the tables of a transponder
+// are collected in parallel instead of one timeout after the other
+class TableReader : public Thread
+{
+  public:
+    TableReader( Frontend &frontend, unsigned char table_id, uint16_t pid, int timeout ) :
+      frontend(frontend), table_id(table_id), pid(pid), timeout(timeout), table(NULL) { }
+    virtual ~TableReader( ) { JoinThread( ); }
+
+    bool Start( ) { return StartThread( ); }
+    void *Wait( ) { JoinThread( ); return table; }
+
+  private:
+    Frontend &frontend;
+    unsigned char table_id;
+    uint16_t pid;
+    int timeout;
+    void *table;
+
+    virtual void Run( )
+    {
+      int fd = frontend.OpenDemux( );
+      if( fd < 0 )
+      {
+        frontend.LogError( "unable to open adapter demux" );
+        return;
+      }
+      dvb_read_section( frontend.GetFE( ), fd, table_id, pid, &table, timeout );
+      frontend.CloseDemux( fd );
+    }
+};
+
 Activity_Scan::Activity_Scan( ) : Activity( )
 {
 }
@@ -62,13 +100,19 @@ std::string Activity_Scan::GetTitle( ) const
 
 bool Activity_Scan::Perform( )
 {
-  struct timeval tv;
-  int ret;
-  const char *err;
   int time = 5;
+  bool result = false;
   std::vector<uint16_t> services;
   int fd_demux;
   struct dvb_table_pat *pat = NULL;
+  struct dvb_table_sdt *sdt = NULL;
+  struct dvb_table_nit *nit = NULL;
+  struct dvb_table_nit *nit_other = NULL;
+  struct dvb_table_cat *cat = NULL;
+  TableReader sdt_reader( *frontend, DVB_TABLE_SDT, DVB_TABLE_SDT_PID, time );
+  TableReader nit_reader( *frontend, DVB_TABLE_NIT, DVB_TABLE_NIT_PID, time );
+  TableReader nit_other_reader( *frontend, DVB_TABLE_NIT2, DVB_TABLE_NIT_PID, time );
+  TableReader cat_reader( *frontend, DVB_TABLE_CAT, DVB_TABLE_CAT_PID, time );
 
   if(( fd_demux = frontend->OpenDemux( )) < 0 )
   {
@@ -78,8 +122,21 @@ bool Activity_Scan::Perform( )
 
   transponder->SetState( Transponder::State_Scanning );
 
-  frontend->Log( "Reading PAT" );
+  if( transponder->HasSDT( ))
+    sdt_reader.Start( );
+  if( transponder->HasNIT( ))
+  {
+    nit_reader.Start( );
+    nit_other_reader.Start( );
+  }
+  cat_reader.Start( ); // FIXME: && transponder->HasNIT( )
+
+  frontend->Log( "Reading PAT, SDT, NIT and CAT" );
   dvb_read_section( frontend->GetFE( ), fd_demux, DVB_TABLE_PAT, DVB_TABLE_PAT_PID, (void **) &pat, time );
+  sdt = (struct dvb_table_sdt *) sdt_reader.Wait( );
+  nit = (struct dvb_table_nit *) nit_reader.Wait( );
+  nit_other = (struct dvb_table_nit *) nit_other_reader.Wait( );
+  cat = (struct dvb_table_cat *) cat_reader.Wait( );
   if( !pat )
   {
     frontend->LogError( "Error reading PAT table" );
@@ -127,212 +184,274 @@ bool Activity_Scan::Perform( )
   }
 */
 
-  if( transponder->HasSDT( ))
+  if( sdt )
   {
-    frontend->Log( "Reading SDT" );
-    struct dvb_table_sdt *sdt;
-    dvb_read_section( frontend->GetFE( ), fd_demux, DVB_TABLE_SDT, DVB_TABLE_SDT_PID, (void **) &sdt, time );
-    if( sdt )
+    dvb_table_sdt_print( frontend->GetFE( ), sdt );
+    dvb_sdt_service_foreach( service, sdt )
     {
-      dvb_table_sdt_print( frontend->GetFE( ), sdt );
-      dvb_sdt_service_foreach( service, sdt )
+      const char *name = "", *provider = "";
+      int service_type = -1;
+      dvb_desc_find( struct dvb_desc_service, desc, service, service_descriptor )
       {
-        const char *name = "", *provider = "";
-        int service_type = -1;
-        dvb_desc_find( struct dvb_desc_service, desc, service, service_descriptor )
-        {
-          service_type = desc->service_type;
-          if( desc->name )
-            name = desc->name;
-          if( desc->provider )
-            provider = desc->provider;
+        service_type = desc->service_type;
+        if( desc->name )
+          name = desc->name;
+        if( desc->provider )
+          provider = desc->provider;
+        break;
+      }
+      if( service_type == -1 )
+      {
+        frontend->LogWarn( "  No service descriptor found for service %d", service->service_id );
+        continue;
+      }
+
+      Service::Type type = Service::Type_Unknown;
+      switch( service_type )
+      {
+        case 0x01:
+        case 0x16:
+          type = Service::Type_TV;
           break;
-        }
-        if( service_type == -1 )
-        {
-          frontend->LogWarn( "  No service descriptor found for service %d", service->service_id );
+        case 0x02:
+          type = Service::Type_Radio;
+          break;
+        case 0x19:
+          type = Service::Type_TVHD;
+          break;
+        case 0x0c:
+          // Data ignored
           continue;
-        }
-
-        Service::Type type = Service::Type_Unknown;
-        switch( service_type )
-        {
-          case 0x01:
-          case 0x16:
-            type = Service::Type_TV;
-            break;
-          case 0x02:
-            type = Service::Type_Radio;
-            break;
-          case 0x19:
-            type = Service::Type_TVHD;
-            break;
-          case 0x0c:
-            // Data ignored
-            continue;
 
-        }
-
-        if( type == Service::Type_Unknown )
-        {
-          frontend->LogWarn( "  Service %5d: %s '%s': unknown type: %d", service->service_id, service->free_CA_mode ? "§" : " ", name, service_type );
-          continue;
-        }
+      }
 
-        frontend->Log( "  Service %5d: %s %-6s '%s'", service->service_id, service->free_CA_mode ? "§" : " ", Service::GetTypeName( type ), name );
-        transponder->UpdateService( service->service_id, type, name, provider );
-        services.push_back( service->service_id );
+      if( type == Service::Type_Unknown )
+      {
+        frontend->LogWarn( "  Service %5d: %s '%s': unknown type: %d", service->service_id, service->free_CA_mode ? "§" : " ", name, service_type );
+        continue;
       }
 
-      dvb_table_sdt_free( sdt );
+      frontend->Log( "  Service %5d: %s %-6s '%s'", service->service_id, service->free_CA_mode ? "§" : " ", Service::GetTypeName( type ), name );
+      transponder->UpdateService( service->service_id, type, name, provider );
+      services.push_back( service->service_id );
     }
   }
 
   frontend->Log( "Reading PMT's" );
-  dvb_pat_program_foreach( program, pat )
   {
-    for( std::vector<uint16_t>::iterator it = services.begin( ); it != services.end( ); it++ )
+    // pid -> services whose PMT is still missing
+    std::map<uint16_t, std::set<uint16_t> > pending;
+    dvb_pat_program_foreach( program, pat )
     {
-      if( !IsActive( ))
-        break;
-      if( *it == 0 )
+      if( program->service_id == 0 )
       {
         frontend->LogWarn( "  Ignoring PAT of service 0" );
         continue;
       }
-      if( *it == program->service_id )
-      {
-
-        transponder->UpdateProgram( program->service_id, program->pid );
-
-        frontend->Log( "Reading PMT %04x", program->pid );
-        struct dvb_table_pmt *pmt;
-        dvb_read_section( frontend->GetFE( ), fd_demux, DVB_TABLE_PMT, program->pid, (void **) &pmt, time );
-        if( !pmt )
-        {
-          frontend->LogWarn( "  No PMT for pid %d", program->pid );
-          break;
-        }
+      if( std::find( services.begin( ), services.end( ), program->service_id ) == services.end( ))
+        continue;
+      transponder->UpdateProgram( program->service_id, program->pid );
+      pending[program->pid].insert( program->service_id );
+    }
 
-        dvb_desc_find( struct dvb_desc_ca, desc, pmt, conditional_access_descriptor )
+    // keep as many PMT filters running as the pool allows
+    SectionFilterPool pool( *frontend );
+    std::map<int, time_t> started;
+    std::map<uint16_t, std::set<uint16_t> >::iterator queue = pending.begin( );
+    uint8_t data[4096]; // max section size
+    while( IsActive( ) && ( queue != pending.end( ) || pool.GetCount( ) > 0 ))
+    {
+      while( queue != pending.end( ) && !pool.IsFull( ))
+      {
+        int filter = pool.Add( queue->first, DVB_TABLE_PMT );
+        if( filter < 0 )
         {
-          transponder->SetCA( program->service_id, desc->ca_id, desc->ca_pid );
+          if( pool.GetCount( ) > 0 )
+            break; // out of demux filters, retry when one is done
+          frontend->LogWarn( "  No PMT for pid %d", queue->first );
         }
+        else
+          started[filter] = ::time( NULL );
+        queue++;
+      }
 
-        dvb_table_pmt_print( frontend->GetFE( ), pmt );
-
-        dvb_pmt_stream_foreach( stream, pmt )
+      int filter;
+      ssize_t len = pool.Read( filter, data, sizeof( data ), 500 );
+      if( len < 0 )
+        break;
+      if( len > 0 )
+      {
+        uint16_t pid = pool.GetPID( filter );
+        struct dvb_table_pmt *pmt = NULL;
+        dvb_table_pmt_init( frontend->GetFE( ), data, len, &pmt );
+        if( pmt )
         {
-          if( !IsActive( ))
-            break;
-          Stream::Type type = Stream::Type_Unknown;
-          switch( stream->type )
+          std::set<uint16_t> &ids = pending[pid];
+          if( ids.erase( pmt->header.id ))
           {
-            case stream_video:            // 0x01
-              type = Stream::Type_Video;
-              break;
-            case stream_video_h262:       // 0x02
-              type = Stream::Type_Video_H262;
-              break;
-            case 0x1b:                    // 0x1b H.264 AVC
-              type = Stream::Type_Video_H264;
-              break;
-
-            case stream_audio:            // 0x03
-              type = Stream::Type_Audio;
-              break;
-            case stream_audio_13818_3:    // 0x04
-              type = Stream::Type_Audio_13818_3;
-              break;
-            case stream_audio_adts:       // 0x0F
-              type = Stream::Type_Audio_ADTS;
-              break;
-            case stream_audio_latm:       // 0x11
-              type = Stream::Type_Audio_LATM;
-              break;
-            case stream_audio_a52:      // 0x81
-              type = Stream::Type_Audio_AC3;
-              break;
-
-            case stream_private_sections: // 0x05
-            case stream_private_data:     // 0x06
-              dvb_desc_find( struct dvb_desc, desc, stream, AC_3_descriptor )
-              {
-                type = Stream::Type_Audio_AC3;
-                break;
-              }
-              dvb_desc_find( struct dvb_desc, desc, stream, enhanced_AC_3_descriptor )
-              {
-                type = Stream::Type_Audio_AC3;
-                frontend->LogWarn( "  Found AC3 enhanced" );
-                break;
-              }
-              break;
-
-            default:
-              frontend->LogWarn( "  Ignoring stream type %d: %s", stream->type, pmt_stream_name[stream->type] );
-              break;
+            frontend->Log( "PMT %04x of service %d", pid, pmt->header.id );
+            ReadPMT( pmt->header.id, pmt );
+          }
+          dvb_table_pmt_free( pmt );
+          if( ids.empty( ))
+          {
+            pool.Remove( filter );
+            started.erase( filter );
           }
-          if( type != Stream::Type_Unknown )
-            transponder->UpdateStream( program->service_id, stream->elementary_pid, type );
         }
+      }
 
-        dvb_table_pmt_free( pmt );
-        break;
+      time_t now = ::time( NULL );
+      for( std::map<int, time_t>::iterator it = started.begin( ); it != started.end( ); )
+      {
+        if( difftime( now, it->second ) < time )
+        {
+          it++;
+          continue;
+        }
+        frontend->LogWarn( "  No PMT for pid %d", pool.GetPID( it->first ));
+        pool.Remove( it->first );
+        started.erase( it++ );
       }
     }
   }
-  if( pat )
-    dvb_table_pat_free( pat );
 
-  if( IsActive( ) && transponder->HasNIT( ))
+  if( IsActive( ) && nit )
   {
-    frontend->Log( "Reading NIT" );
-    struct dvb_table_nit *nit;
-    dvb_read_section( frontend->GetFE( ), fd_demux, DVB_TABLE_NIT, DVB_TABLE_NIT_PID, (void **) &nit, time );
-    if( nit )
+    dvb_desc_find( struct dvb_desc_network_name, desc, nit, network_name_descriptor )
     {
-      dvb_desc_find( struct dvb_desc_network_name, desc, nit, network_name_descriptor )
-      {
-        frontend->Log( "  Network Name: %s", desc->network_name );
-        //transponder->SetNetwork( desc->network_name );
-        break;
-      }
-      dvb_table_nit_print( frontend->GetFE( ), nit );
-      frontend->HandleNIT( nit );
+      frontend->Log( "  Network Name: %s", desc->network_name );
+      //transponder->SetNetwork( desc->network_name );
+      break;
     }
-    if( nit )
-      dvb_table_nit_free( nit );
+    dvb_table_nit_print( frontend->GetFE( ), nit );
+    frontend->HandleNIT( nit );
   }
 
+  // transponders of other networks on the same source
+  if( IsActive( ) && nit_other )
+  {
+    dvb_table_nit_print( frontend->GetFE( ), nit_other );
+    frontend->HandleNIT( nit_other );
+  }
 
-  if( IsActive( ) ) // FIXME: && transponder->HasNIT( ))
+  if( IsActive( ) && cat )
   {
-    frontend->Log( "Reading CAT" );
-    struct dvb_table_cat *cat;
-    dvb_read_section( frontend->GetFE( ), fd_demux, DVB_TABLE_CAT, DVB_TABLE_CAT_PID, (void **) &cat, time );
-    if( cat )
+    dvb_desc_find( struct dvb_desc_ca, desc, cat, conditional_access_descriptor )
     {
-      dvb_desc_find( struct dvb_desc_ca, desc, cat, conditional_access_descriptor )
-      {
-        transponder->SetCA( desc->ca_id, desc->ca_pid );
-      }
-      dvb_table_cat_print( frontend->GetFE( ), cat );
-      dvb_table_cat_free( cat );
+      transponder->SetCA( desc->ca_id, desc->ca_pid );
     }
+    dvb_table_cat_print( frontend->GetFE( ), cat );
   }
 
-  frontend->CloseDemux( fd_demux );
+  transponder->SetProbe( false );
   transponder->SetState( Transponder::State_Scanned );
   transponder->SaveConfig( );
-  return true;
+  result = true;
+  goto scan_done;
 
 scan_failed:
+  // a probe that locked is a transponder, even if its tables could not be read
+  transponder->SetProbe( false );
   transponder->SetState( Transponder::State_ScanningFailed );
   transponder->SaveConfig( );
 scan_aborted:
+scan_done:
   frontend->CloseDemux( fd_demux );
 open_failed:
-  return false;
+  if( pat )
+    dvb_table_pat_free( pat );
+  if( sdt )
+    dvb_table_sdt_free( sdt );
+  if( nit )
+    dvb_table_nit_free( nit );
+  if( nit_other )
+    dvb_table_nit_free( nit_other );
+  if( cat )
+    dvb_table_cat_free( cat );
+  return result;
+}
+
+void Activity_Scan::Failed( )
+{
+  // a blind scan frequency without lock is no transponder. a busy frontend
+  // or a failed port setup says nothing about the frequency.
+  if( transponder and transponder->IsProbe( ) and transponder->GetState( ) == Transponder::State_NoSignal )
+  {
+    frontend->Log( "Dropping %s", transponder->toString( ).c_str( ));
+    transponder->GetSource( ).RemoveTransponder( transponder );
+    transponder = NULL;
+  }
 }
 
+void Activity_Scan::ReadPMT( uint16_t service_id, struct dvb_table_pmt *pmt )
+{
+  dvb_desc_find( struct dvb_desc_ca, desc, pmt, conditional_access_descriptor )
+  {
+    transponder->SetCA( service_id, desc->ca_id, desc->ca_pid );
+  }
+
+  dvb_table_pmt_print( frontend->GetFE( ), pmt );
+
+  dvb_pmt_stream_foreach( stream, pmt )
+  {
+    if( !IsActive( ))
+      break;
+    Stream::Type type = Stream::Type_Unknown;
+    switch( stream->type )
+    {
+      case stream_video:            // 0x01
+        type = Stream::Type_Video;
+        break;
+      case stream_video_h262:       // 0x02
+        type = Stream::Type_Video_H262;
+        break;
+      case 0x1b:                    // 0x1b H.264 AVC
+        type = Stream::Type_Video_H264;
+        break;
+
+      case stream_audio:            // 0x03
+        type = Stream::Type_Audio;
+        break;
+      case stream_audio_13818_3:    // 0x04
+        type = Stream::Type_Audio_13818_3;
+        break;
+      case stream_audio_adts:       // 0x0F
+        type = Stream::Type_Audio_ADTS;
+        break;
+      case stream_audio_latm:       // 0x11
+        type = Stream::Type_Audio_LATM;
+        break;
+      case stream_audio_a52:      // 0x81
+        type = Stream::Type_Audio_AC3;
+        break;
+
+      case stream_private_sections: // 0x05
+      case stream_private_data:     // 0x06
+        dvb_desc_find( struct dvb_desc, desc, stream, AC_3_descriptor )
+        {
+          type = Stream::Type_Audio_AC3;
+          break;
+        }
+        dvb_desc_find( struct dvb_desc, desc, stream, enhanced_AC_3_descriptor )
+        {
+          type = Stream::Type_Audio_AC3;
+          frontend->LogWarn( "  Found AC3 enhanced" );
+          break;
+        }
+        break;
+
+      default:
+        frontend->LogWarn( "  Ignoring stream type %d: %s", stream->type, pmt_stream_name[stream->type] );
+        break;
+    }
+    std::string language;
+    dvb_desc_find( struct dvb_desc_language, desc, stream, iso639_language_descriptor )
+    {
+      language = (const char *) desc->language;
+      break;
+    }
+    if( type != Stream::Type_Unknown )
+      transponder->UpdateStream( service_id, stream->elementary_pid, type, language );
+  }
+}
@@ -31,6 +31,8 @@
 #include "CAMClient.h"
 #include "Activity_Record.h"
 #include "MPEGTS.h"
+#include "PSIInjector.h"
+#include "Recorder.h"
 
 #include <libdvbv5/pat.h>
 #include <libdvbv5/eit.h>
@@ -232,50 +234,19 @@ bool Activity_Stream::StreamChannel( )
 
   frontend->Log( "Streaming ..." );
 
+  PSIInjector psi( Recorder::Instance( )->GetPSIInterval( ));
+  bool psi_ok = psi.AddSDT( frontend->GetFE( ), sdt ) &&
+                psi.AddPAT( frontend->GetFE( ), pat ) &&
+                psi.AddPMT( frontend->GetFE( ), pmt, 0x1000 );
+  dvb_table_sdt_free( sdt );
+  dvb_table_pat_free( pat );
+  dvb_table_pmt_free( pmt );
+  if( !psi_ok )
   {
-    /* SDT */
-    uint8_t *data;
-    ssize_t size = dvb_table_sdt_store( frontend->GetFE( ), sdt, &data );
-    dvb_table_sdt_free( sdt );
-    if( !data )
-    {
-      frontend->LogError( "cannot store" );
-      return -2;
-    }
-
-    uint8_t *mpegts;
-    size = dvb_mpeg_ts_create( frontend->GetFE( ), data, size, &mpegts, DVB_TABLE_SDT_PID, 0 );
-    free( data );
-    SendRTP( mpegts, size );
-    free( mpegts );
-
-    /* PAT */
-    size = dvb_table_pat_store( frontend->GetFE( ), pat, &data );
-    dvb_table_pat_free( pat );
-    if( !data )
-    {
-      frontend->LogError( "cannot store" );
-      return -2;
-    }
-
-    size = dvb_mpeg_ts_create( frontend->GetFE( ), data, size, &mpegts, DVB_TABLE_PAT_PID, 0 );
-    free( data );
-    SendRTP( mpegts, size );
-    free( mpegts );
-
-    /* PMT */
-    size = dvb_table_pmt_store( frontend->GetFE( ), pmt, &data );
-    dvb_table_pmt_free( pmt );
-    if( !data )
-    {
-      frontend->LogError( "cannot store" );
-      return -2;
-    }
-
-    size = dvb_mpeg_ts_create( frontend->GetFE( ), data, size, &mpegts, 0x1000, 0 );
-    free( data );
-    SendRTP( mpegts, size );
-    free( mpegts );
+    frontend->LogError( "cannot create PSI tables" );
+    for( std::vector<int>::iterator it = fds.begin( ); it != fds.end( ); it++ )
+      frontend->CloseDemux( *it );
+    return false;
   }
 
   fd_set tmp_fdset;
@@ -379,7 +350,13 @@ bool Activity_Stream::StreamChannel( )
         len = read( fd, data, DMX_BUFSIZE );
         if( len < 0 )
         {
-          frontend->LogError( "Error receiving data... %d", errno );
+          if( errno == EOVERFLOW )
+          {
+            frontend->LogWarn( "Demux buffer overflow, data lost" );
+            monitor.Overflow( );
+          }
+          else
+            frontend->LogError( "Error receiving data... %d", errno );
           continue;
         }
 
@@ -403,6 +380,15 @@ bool Activity_Stream::StreamChannel( )
 
           p += chunk;
         }
+        monitor.Process( data, len );
+
+        if( psi.Due( ))
+        {
+          size_t size;
+          const uint8_t *tables = psi.GetPackets( size );
+          for( size_t i = 0; i < size; i += 7 * 188 )
+            SendRTP( tables + i, size - i < 7 * 188 ? size - i : 7 * 188 );
+        }
 
         p = data;
         while( len > 0 )
@@ -24,6 +24,7 @@
 #include "Log.h"
 #include "Frontend.h"
 #include "Channel.h"
+#include "SectionFilterPool.h"
 
 #include <libdvbv5/dvb-fe.h>
 #include <libdvbv5/eit.h>
@@ -50,14 +51,7 @@ std::string Activity_UpdateEPG::GetTitle( ) const
 
 bool Activity_UpdateEPG::Perform( )
 {
-  int timeout = 2; // seconds
-  int fd_demux;
-
-  if(( fd_demux = frontend->OpenDemux( )) < 0 )
-  {
-    frontend->LogError( "unable to open adapter demux" );
-    goto fail;
-  }
+  int timeout = 2; // seconds without a new section
 /*
   if( transponder->HasMGT( ))
   {
@@ -106,36 +100,46 @@ bool Activity_UpdateEPG::Perform( )
   else // no MGT
 */
   {
+    // read the EIT sections until only known ones come in
     frontend->Log( "Reading EIT" );
-    struct dvb_table_eit *eit = NULL;
-    struct dvb_table_filter eit_filter;
-    eit_filter.tid = DVB_TABLE_EIT_SCHEDULE;
-    eit_filter.pid = DVB_TABLE_EIT_PID;
-    eit_filter.ts_id = -1;
-    eit_filter.table = (void **) &eit;
-    eit_filter.allow_section_gaps = 1;
-    dvb_read_sections( frontend->GetFE( ), fd_demux, &eit_filter, timeout );
-    if( eit )
+    SectionFilterPool pool( *frontend );
+    if( pool.Add( DVB_TABLE_EIT_PID ) < 0 )
     {
-      transponder->ReadEPG( eit->event );
-      dvb_table_eit_free( eit );
+      frontend->LogError( "unable to set EIT section filter" );
+      goto fail;
     }
-    else
+
+    uint8_t data[4096]; // max section size
+    int filter;
+    int sections = 0, events = 0;
+    time_t start = time( NULL ), last_new = start, now = start;
+    while( IsActive( ) and difftime( now, last_new ) < timeout and difftime( now, start ) < EPG_UPDATE_MAX )
     {
-      frontend->Log( "Reading EIT now/next" );
-      eit_filter.tid = DVB_TABLE_EIT;
-      dvb_read_sections( frontend->GetFE( ), fd_demux, &eit_filter, timeout );
-      if( eit )
+      ssize_t len = pool.Read( filter, data, sizeof( data ), 500 );
+      if( len < 0 )
+        break;
+      if( len > 0 )
       {
-        transponder->ReadEPG( eit->event );
-        dvb_table_eit_free( eit );
+        sections++;
+        int count = transponder->AddEITSection( frontend->GetFE( ), data, len );
+        if( count >= 0 )
+        {
+          last_new = time( NULL );
+          events += count;
+        }
       }
-      else
-        transponder->SetEPGState( Transponder::EPGState_NotAvailable );
+      now = time( NULL );
     }
+    pool.Clear( );
 
-    frontend->CloseDemux( fd_demux );
-    return eit != NULL;
+    if( sections == 0 )
+    {
+      transponder->SetEPGState( Transponder::EPGState_NotAvailable );
+      return false;
+    }
+    frontend->Log( "EIT: %d sections, %d new or changed events", sections, events );
+    transponder->SaveEPG( );
+    return true;
   }
 
 fail:
@@ -33,10 +33,19 @@
 #include "Log.h"
 #include <libdvbv5/eit.h>
 
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>   // strerror
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 Channel::Channel( TVDaemon &tvd, Service *service, int config_id ) :
   ConfigObject( tvd, "channel", config_id ),
   tvd(tvd),
-  number(config_id + 1)
+  number(config_id + 1),
+  popularity(0),
+  epg_modified(false)
 {
   name = service->GetName( );
   services.push_back( service );
@@ -45,7 +54,9 @@ Channel::Channel( TVDaemon &tvd, Service *service, int config_id ) :
 
 Channel::Channel( TVDaemon &tvd, std::string configfile ) :
   ConfigObject( tvd, configfile ),
-  tvd(tvd)
+  tvd(tvd),
+  popularity(0),
+  epg_modified(false)
 {
   epg = false;
 }
@@ -59,16 +70,10 @@ bool Channel::SaveConfig( )
 {
   WriteConfig( "Name", name );
   WriteConfig( "Number", number );
+  WriteConfig( "Popularity", popularity );
+  filter.SaveConfig( *this );
 
-  DeleteConfig( "EPG" );
-  Setting &n = ConfigList( "EPG" );
-  ConfigBase c( n );
-  for( int i = 0; i < events.size( ); i++ )
-  {
-    Setting &n2 = c.ConfigGroup( );
-    ConfigBase c2( n2 );
-    events[i]->SaveConfig( c2 );
-  }
+  DeleteConfig( "EPG" ); // see SaveEPG
 
   return WriteConfigFile( );
 }
@@ -79,18 +84,160 @@ bool Channel::LoadConfig( )
     return false;
   ReadConfig( "Name", name );
   ReadConfig( "Number", number );
+  ReadConfig( "Popularity", popularity );
+  filter.LoadConfig( *this );
+
+  if( !LoadEPG( ))
+  {
+    // older versions kept the EPG in the channel config
+    Setting &n = ConfigList( "EPG" );
+    for( int i = 0; i < n.getLength( ); i++ )
+    {
+      ConfigBase c2( n[i] );
+      Event *e = new Event( *this );
+      e->LoadConfig( c2 );
+      InsertEvent( e );
+    }
+    if( !events.empty( ))
+      SaveEPG( );
+  }
+  return true;
+}
+
+bool Channel::RemoveConfigFile( )
+{
+  unlink( GetEPGFile( ).c_str( ));
+  return ConfigObject::RemoveConfigFile( );
+}
+
+struct epg_file_header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+};
+
+bool Channel::SaveEPG( )
+{
+  // collectors on different transponders may save the same channel, keep
+  // snapshots from interleaving or an older one being renamed last
+  ScopeLock _s( save_mutex );
+  std::string buffer;
+  {
+    ScopeLock _l( mutex );
+    if( !epg_modified )
+      return true;
+    epg_modified = false;
+    struct epg_file_header header = { EPG_FILE_MAGIC, EPG_FILE_VERSION, (uint32_t) events.size( ) };
+    buffer.append((const char *) &header, sizeof( header ));
+    for( int i = 0; i < events.size( ); i++ )
+      events[i]->Pack( buffer );
+  }
+
+  // write a new snapshot and replace the old one
+  std::string file = GetEPGFile( );
+  std::string tmp = file + ".tmp";
+  size_t pos = 0;
+  int fd = open( tmp.c_str( ), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if( fd < 0 )
+    goto fail;
+  while( pos < buffer.size( ))
+  {
+    ssize_t r = write( fd, buffer.data( ) + pos, buffer.size( ) - pos );
+    if( r < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      close( fd );
+      goto fail;
+    }
+    pos += r;
+  }
+  // the data has to be on disk before the rename replaces the old snapshot
+  if( fsync( fd ) != 0 )
+  {
+    close( fd );
+    goto fail;
+  }
+  if( close( fd ) != 0 )
+    goto fail;
+  if( rename( tmp.c_str( ), file.c_str( )) != 0 )
+    goto fail;
+  return true;
+
+fail:
+  LogError( "Channel %s: unable to write EPG to '%s': %s", name.c_str( ), tmp.c_str( ), strerror( errno ));
+  unlink( tmp.c_str( ));
+  {
+    ScopeLock _l( mutex );
+    epg_modified = true; // try again next time
+  }
+  return false;
+}
+
+bool Channel::LoadEPG( )
+{
+  std::string file = GetEPGFile( );
+  int fd = open( file.c_str( ), O_RDONLY );
+  if( fd < 0 )
+    return false;
+
+  struct stat st;
+  if( fstat( fd, &st ) != 0 or st.st_size < sizeof( struct epg_file_header ))
+  {
+    close( fd );
+    return false;
+  }
+  void *map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if( map == MAP_FAILED )
+    return false;
+
+  const uint8_t *data = (const uint8_t *) map;
+  const uint8_t *end = data + st.st_size;
+  struct epg_file_header header;
+  memcpy( &header, data, sizeof( header ));
+  data += sizeof( header );
+  if( header.magic != EPG_FILE_MAGIC or header.version != EPG_FILE_VERSION )
+  {
+    LogWarn( "Channel %s: ignoring EPG file of unknown format", name.c_str( ));
+    munmap( map, st.st_size );
+    return false;
+  }
 
-  Setting &n = ConfigList( "EPG" );
-  for( int i = 0; i < n.getLength( ); i++ )
+  time_t now = time( NULL );
+  bool dropped = false;
+  for( uint32_t i = 0; i < header.count; i++ )
   {
-    ConfigBase c2( n[i] );
     Event *e = new Event( *this );
-    e->LoadConfig( c2 );
-    events.push_back (e );
+    if( !e->Unpack( data, end ))
+    {
+      LogError( "Channel %s: EPG file truncated", name.c_str( ));
+      delete e;
+      dropped = true;
+      break;
+    }
+    if( e->GetEnd( ) < now )
+    {
+      delete e;
+      dropped = true;
+      continue;
+    }
+    InsertEvent( e );
   }
+  munmap( map, st.st_size );
+  epg_modified = dropped; // unchanged snapshots are not rewritten
   return true;
 }
 
+void Channel::InsertEvent( Event *event )
+{
+  events.push_back( event );
+  event_index[event->GetID( )] = event;
+  tvd.GetEPGStore( ).Add( event );
+  epg_modified = true;
+}
+
 bool Channel::AddService( Service *service )
 {
   if( !service )
@@ -125,6 +272,21 @@ void Channel::json( json_object *entry ) const
     json_object_time_add  ( entry, "last_epg",  (*it)->GetTransponder( ).GetLastEPGUpdate( ));
     break; //FIXME: merge states
   }
+  filter.json( entry );
+}
+
+void Channel::serialize( JSONWriter &writer ) const
+{
+  writer.Add( "name",   name );
+  writer.Add( "number", number );
+  writer.Add( "id",     GetKey( ));
+  for( std::vector<Service *>::const_iterator it = services.begin( ); it != services.end( ); it++ )
+  {
+    writer.Add( "epg_state", (*it)->GetTransponder( ).GetEPGState( ));
+    writer.AddTime( "last_epg", (*it)->GetTransponder( ).GetLastEPGUpdate( ));
+    break; //FIXME: merge states
+  }
+  filter.serialize( writer );
 }
 
 bool Channel::RPC( const HTTPRequest &request,  const std::string &cat, const std::string &action )
@@ -132,25 +294,33 @@ bool Channel::RPC( const HTTPRequest &request,  const std::string &cat, const st
   if( action == "schedule" )
   {
     int event_id;
-    request.GetParam( "event_id", event_id );
-    for( int i = 0; i < events.size( ); i++ )
+    if( !request.GetParam( "event_id", event_id ))
+      return false;
+    int found = -1;
     {
-      if( events[i]->GetID( ) == event_id )
+      // events may expire meanwhile
+      ScopeLock _l( mutex );
+      for( int i = 0; i < events.size( ); i++ )
       {
-        if( tvd.Schedule( *events[i] ))
-        {
-          request.Reply( HTTP_OK );
-          return true;
-        }
-        else
+        if( events[i]->GetID( ) == event_id )
         {
-          request.NotFound( "Event already scheduled" );
-          return false;
+          found = tvd.Schedule( *events[i] ) ? 1 : 0;
+          break;
         }
       }
     }
-    request.NotFound( "Event %d not found", event_id );
-    return false;
+    if( found < 0 )
+    {
+      request.NotFound( "Event %d not found", event_id );
+      return false;
+    }
+    if( !found )
+    {
+      request.NotFound( "Event already scheduled" );
+      return false;
+    }
+    request.Reply( HTTP_OK );
+    return true;
   }
 
   if( action == "record" )
@@ -167,6 +337,14 @@ bool Channel::RPC( const HTTPRequest &request,  const std::string &cat, const st
     return true;
   }
 
+  if( action == "set_stream_filter" )
+  {
+    filter.Set( request );
+    SaveConfig( );
+    request.Reply( HTTP_OK );
+    return true;
+  }
+
   request.NotFound( "RPC: unknown action: '%s'", action.c_str( ));
   return false;
 }
@@ -176,7 +354,10 @@ bool Channel::Tune( Activity &act )
   for( std::vector<Service *>::const_iterator it = services.begin( ); it != services.end( ); it++ )
   {
     if( (*it)->Tune( act ))
+    {
+      popularity++;
       return true;
+    }
   }
   return false;
 }
@@ -192,22 +373,48 @@ void Channel::UpdateEPG( )
 
 void Channel::ClearEPG( )
 {
+  ScopeLock _l( mutex );
+  tvd.GetEPGStore( ).Remove( *this );
   events.clear( );
+  event_index.clear( );
+  epg_modified = true;
 }
 
-bool Channel::AddEPGEvent( const struct dvb_table_eit_event *event )
+bool Channel::AddEPGEvent( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version )
 {
   ScopeLock _l( mutex );
-  for( int i = 0; i < events.size( ); i++ )
+  // the event id identifies the event, its start may move
+  std::unordered_map<uint16_t, Event *>::iterator it = event_index.find( event->event_id );
+  if( it != event_index.end( ))
   {
-    if( events[i]->GetID( ) == event->event_id ) // FIXME: check start time
-    {
-      LogError( "Event %d already registered", event->event_id );
+    if( it->second->IsCurrent( table_id, version )) // carousel repeat
       return false;
+    tvd.GetEPGStore( ).Update( it->second, event, table_id, version );
+    epg_modified = true;
+    return true;
+  }
+
+  InsertEvent( new Event( *this, event, table_id, version ));
+  return true;
+}
+
+void Channel::ExpireEPG( time_t before )
+{
+  ScopeLock _l( mutex );
+  std::vector<Event *>::iterator it = events.begin( );
+  while( it != events.end( ))
+  {
+    if( (*it)->GetEnd( ) >= before )
+    {
+      it++;
+      continue;
     }
+    tvd.GetEPGStore( ).Remove( *it );
+    event_index.erase( (*it)->GetID( ));
+    delete *it;
+    it = events.erase( it );
+    epg_modified = true;
   }
-  Event *e = new Event( *this, event );
-  events.push_back( e );
 }
 
 bool Channel::compare( const JSONObject &other, const int &p ) const
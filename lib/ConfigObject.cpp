@@ -282,7 +282,7 @@ void ConfigBase::WriteConfig( const char *key, float f )
   }
 }
 
-void ConfigBase::WriteConfig( const char *key, std::string &s )
+void ConfigBase::WriteConfig( const char *key, const std::string &s )
 {
   try
   {
@@ -0,0 +1,130 @@
+/*
+ *  tvdaemon
+ *
+ *  EITCollector class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EITCollector.h"
+
+#include "Frontend.h"
+#include "Transponder.h"
+#include "Log.h"
+
+#include <poll.h>
+#include <errno.h>
+#include <string.h> // strerror
+#include <unistd.h>
+#include <libdvbv5/eit.h>
+#include <libdvbv5/dvb-demux.h>
+
+EITCollector::EITCollector( Frontend &frontend, Transponder &transponder ) :
+  frontend(frontend),
+  transponder(transponder),
+  fd(-1),
+  up(false),
+  events(0),
+  last_save(0)
+{
+}
+
+EITCollector::~EITCollector( )
+{
+  Stop( );
+}
+
+bool EITCollector::Start( )
+{
+  fd = frontend.OpenDemux( );
+  if( fd < 0 )
+    return false;
+  if( dvb_set_section_filter( fd, DVB_TABLE_EIT_PID, 0, NULL, NULL, NULL, DMX_IMMEDIATE_START | DMX_CHECK_CRC ) < 0 )
+  {
+    frontend.LogError( "EITCollector: unable to set section filter" );
+    goto fail;
+  }
+
+  last_save = time( NULL );
+  up = true;
+  if( !StartThread( ))
+  {
+    up = false;
+    goto fail;
+  }
+  transponder.SetCollecting( true ); // keep the EPG scheduler off this mux
+  return true;
+
+fail:
+  frontend.CloseDemux( fd );
+  fd = -1;
+  return false;
+}
+
+void EITCollector::Stop( )
+{
+  if( !up )
+    return;
+  up = false;
+  JoinThread( );
+  frontend.CloseDemux( fd );
+  fd = -1;
+  transponder.SetCollecting( false );
+}
+
+void EITCollector::Run( )
+{
+  uint8_t data[4096]; // max section size
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  while( up )
+  {
+    int r = poll( &pfd, 1, 1000 );
+    if( r > 0 )
+    {
+      ssize_t len = read( fd, data, sizeof( data ));
+      if( len > 0 )
+        Process( data, len );
+      else if( len < 0 and errno != EOVERFLOW and errno != EAGAIN and errno != EINTR )
+      {
+        frontend.LogError( "EITCollector: read error: %s", strerror( errno ));
+        break;
+      }
+    }
+    if( difftime( time( NULL ), last_save ) >= EIT_COLLECTOR_SAVE )
+      Save( );
+  }
+  Save( );
+}
+
+void EITCollector::Process( const uint8_t *data, ssize_t len )
+{
+  int count = transponder.AddEITSection( frontend.GetFE( ), data, len );
+  if( count > 0 )
+    events += count;
+}
+
+void EITCollector::Save( )
+{
+  last_save = time( NULL );
+  if( events == 0 )
+    return;
+  frontend.Log( "EITCollector: %d new or changed EPG events", events );
+  events = 0;
+  transponder.SaveEPG( );
+}
@@ -0,0 +1,51 @@
+/*
+ *  tvdaemon
+ *
+ *  EITSectionCache class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EITSectionCache.h"
+
+bool EITSectionCache::Changed( const uint8_t *section, ssize_t len )
+{
+  // table_id, section_length (12 bit), service_id, version (5 bit),
+  // section_number, ..., CRC32
+  if( len < 12 )
+    return true;
+  size_t section_length = (( section[1] & 0x0F ) << 8 ) | section[2];
+  if( section_length + 3 > (size_t) len || section_length < 4 )
+    return true;
+
+  uint32_t key = ((uint32_t) section[0] << 24 ) | ( section[3] << 16 ) | ( section[4] << 8 ) | section[6];
+  const uint8_t *crc = section + 3 + section_length - 4;
+  uint64_t value = ((uint64_t) (( section[5] >> 1 ) & 0x1F ) << 32 ) |
+                   ((uint32_t) crc[0] << 24 ) | ( crc[1] << 16 ) | ( crc[2] << 8 ) | crc[3];
+
+  SCOPELOCK( );
+  std::unordered_map<uint32_t, uint64_t>::iterator it = sections.find( key );
+  if( it != sections.end( ) and it->second == value )
+    return false;
+  sections[key] = value;
+  return true;
+}
+
+void EITSectionCache::Clear( )
+{
+  SCOPELOCK( );
+  sections.clear( );
+}
@@ -0,0 +1,408 @@
+/*
+ *  tvdaemon
+ *
+ *  EPGStore class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EPGStore.h"
+
+#include "Event.h"
+#include "Channel.h"
+
+#include <algorithm>
+#include <iterator> // back_inserter, distance
+#include <ctype.h>
+
+bool EPGStore::Key::operator<( const Key &other ) const
+{
+  if( start != other.start )
+    return start < other.start;
+  if( event == other.event )
+    return false;
+  if( !event )
+    return true;
+  if( !other.event )
+    return false;
+
+  const Channel &a = event->GetChannel( );
+  const Channel &b = other.event->GetChannel( );
+  if( &a != &b )
+  {
+    // same order as Event::compare: start, then channel name
+    if( a.GetName( ) < b.GetName( ))
+      return true;
+    if( b.GetName( ) < a.GetName( ))
+      return false;
+    return &a < &b;
+  }
+  if( event->GetID( ) != other.event->GetID( ))
+    return event->GetID( ) < other.event->GetID( );
+  return event < other.event;
+}
+
+EPGStore::EPGStore( ) : max_duration(0)
+{
+}
+
+EPGStore::~EPGStore( )
+{
+}
+
+void EPGStore::Add( Event *event )
+{
+  SCOPELOCK( );
+  Insert( event );
+}
+
+void EPGStore::Remove( Event *event )
+{
+  SCOPELOCK( );
+  Erase( event );
+}
+
+void EPGStore::Update( Event *event, const struct dvb_table_eit_event *data, uint8_t table_id, uint8_t version )
+{
+  SCOPELOCK( );
+  // start and words may change, reindex
+  bool indexed = Erase( event );
+  event->Update( data, table_id, version );
+  if( indexed )
+    Insert( event );
+}
+
+bool EPGStore::Insert( Event *event )
+{
+  if( !events.insert( Key( event->GetStart( ), event )).second )
+    return false;
+  channels[&event->GetChannel( )].insert( std::make_pair( event->GetStart( ), event ));
+  if( event->GetDuration( ) > max_duration )
+    max_duration = event->GetDuration( );
+  IndexWords( event );
+  return true;
+}
+
+bool EPGStore::Erase( Event *event )
+{
+  if( events.erase( Key( event->GetStart( ), event )) == 0 )
+    return false;
+  UnindexWords( event );
+
+  std::map<const Channel *, ChannelIndex>::iterator it = channels.find( &event->GetChannel( ));
+  if( it == channels.end( ))
+    return true;
+  std::pair<ChannelIndex::iterator, ChannelIndex::iterator> range = it->second.equal_range( event->GetStart( ));
+  for( ChannelIndex::iterator it2 = range.first; it2 != range.second; it2++ )
+    if( it2->second == event )
+    {
+      it->second.erase( it2 );
+      break;
+    }
+  if( it->second.empty( ))
+    channels.erase( it );
+  return true;
+}
+
+void EPGStore::Remove( const Channel &channel )
+{
+  SCOPELOCK( );
+  std::map<const Channel *, ChannelIndex>::iterator it = channels.find( &channel );
+  if( it == channels.end( ))
+    return;
+  for( ChannelIndex::iterator it2 = it->second.begin( ); it2 != it->second.end( ); it2++ )
+  {
+    events.erase( Key( it2->first, it2->second ));
+    UnindexWords( it2->second );
+  }
+  channels.erase( it );
+}
+
+EPGStore::ChannelIndex::const_iterator EPGStore::First( const ChannelIndex &index, time_t from )
+{
+  // events of a channel do not overlap, only the last one starting
+  // before 'from' can still be running
+  ChannelIndex::const_iterator it = index.upper_bound( from );
+  if( it != index.begin( ))
+  {
+    ChannelIndex::const_iterator prev = it;
+    prev--;
+    if( prev->second->GetEnd( ) > from )
+      it = index.lower_bound( prev->first );
+  }
+  return it;
+}
+
+int EPGStore::CountWindow( const ChannelIndex &index, time_t from, time_t to )
+{
+  ChannelIndex::const_iterator first = First( index, from );
+  // open ended windows only walk the events already over
+  if( !to )
+    return index.size( ) - std::distance( index.begin( ), first );
+  if( first == index.end( ) or first->first >= to )
+    return 0;
+  return std::distance( first, index.lower_bound( to ));
+}
+
+void EPGStore::Get( time_t from, time_t to, std::vector<Event *> &result ) const
+{
+  SCOPELOCK( );
+  // an event overlapping 'from' started at most max_duration before
+  std::set<Key>::const_iterator it = events.lower_bound( Key( from - max_duration, NULL ));
+  for( ; it != events.end( ); it++ )
+  {
+    if( to && it->start >= to )
+      break;
+    if( it->event->GetEnd( ) > from )
+      result.push_back( it->event );
+  }
+}
+
+void EPGStore::Get( const Channel &channel, time_t from, time_t to, std::vector<Event *> &result ) const
+{
+  SCOPELOCK( );
+  std::map<const Channel *, ChannelIndex>::const_iterator it = channels.find( &channel );
+  if( it == channels.end( ))
+    return;
+  for( ChannelIndex::const_iterator it2 = First( it->second, from ); it2 != it->second.end( ); it2++ )
+  {
+    if( to && it2->first >= to )
+      break;
+    result.push_back( it2->second );
+  }
+}
+
+EPGStore::Cursor::Cursor( const EPGStore &store, const Channel *channel, time_t from, time_t to ) :
+  lock(store),
+  from(from),
+  to(to),
+  index(NULL),
+  count(0)
+{
+  it = end = store.events.end( );
+  if( !channel )
+  {
+    it = store.events.lower_bound( Key( from - store.max_duration, NULL ));
+    std::map<const Channel *, ChannelIndex>::const_iterator it3;
+    for( it3 = store.channels.begin( ); it3 != store.channels.end( ); it3++ )
+      count += CountWindow( it3->second, from, to );
+    return;
+  }
+  std::map<const Channel *, ChannelIndex>::const_iterator it3 = store.channels.find( channel );
+  if( it3 == store.channels.end( ))
+    return;
+  index = &it3->second;
+  it2 = First( *index, from );
+  count = CountWindow( *index, from, to );
+}
+
+const JSONObject *EPGStore::Cursor::Next( )
+{
+  if( index )
+  {
+    if( it2 == index->end( ) or ( to and it2->first >= to ))
+      return NULL;
+    return (it2++)->second;
+  }
+  while( it != end )
+  {
+    const Key &key = *it++;
+    if( to and key.start >= to )
+    {
+      it = end;
+      break;
+    }
+    if( key.event->GetEnd( ) > from )
+      return key.event;
+  }
+  return NULL;
+}
+
+void EPGStore::GetNowNext( time_t now, std::vector<Event *> &result ) const
+{
+  size_t first = result.size( );
+  for( std::map<const Channel *, ChannelIndex>::const_iterator it = channels.begin( ); it != channels.end( ); it++ )
+  {
+    ChannelIndex::const_iterator it2 = First( it->second, now );
+    if( it2 == it->second.end( ))
+      continue;
+    result.push_back( it2->second );
+    if( it2->first > now ) // nothing running
+      continue;
+    if( ++it2 != it->second.end( ))
+      result.push_back( it2->second );
+  }
+  std::sort( result.begin( ) + first, result.end( ), Sort );
+}
+
+bool EPGStore::Sort( const Event *a, const Event *b )
+{
+  return Key( a->GetStart( ), (Event *) a ) < Key( b->GetStart( ), (Event *) b );
+}
+
+void EPGStore::Tokenize( const std::string &text, std::set<std::string> &tokens, size_t min_length )
+{
+  // words are runs of ASCII alphanumerics and UTF-8 sequences, folded to
+  // lower case
+  std::string word;
+  for( size_t i = 0; i <= text.length( ); i++ )
+  {
+    unsigned char c = i < text.length( ) ? text[i] : ' ';
+    if( c >= 0x80 )
+    {
+      word += c;
+      continue;
+    }
+    if( isalnum( c ))
+    {
+      word += tolower( c );
+      continue;
+    }
+    if( word.length( ) >= min_length )
+      tokens.insert( word );
+    word.clear( );
+  }
+}
+
+void EPGStore::Tokenize( const Event *event, std::set<std::string> &tokens )
+{
+  Tokenize( event->GetName( ), tokens );
+  Tokenize( event->GetDescription( ), tokens );
+  Tokenize( event->GetDescriptionExtended( ), tokens );
+  Tokenize( ((Event *) event)->GetChannel( ).GetName( ), tokens );
+}
+
+void EPGStore::IndexWords( Event *event )
+{
+  std::set<std::string> tokens;
+  Tokenize( event, tokens );
+  for( std::set<std::string>::const_iterator it = tokens.begin( ); it != tokens.end( ); it++ )
+  {
+    Postings &postings = words[*it];
+    Postings::iterator it2 = std::lower_bound( postings.begin( ), postings.end( ), event );
+    if( it2 == postings.end( ) or *it2 != event )
+      postings.insert( it2, event );
+  }
+}
+
+void EPGStore::UnindexWords( Event *event )
+{
+  std::set<std::string> tokens;
+  Tokenize( event, tokens );
+  for( std::set<std::string>::const_iterator it = tokens.begin( ); it != tokens.end( ); it++ )
+  {
+    std::map<std::string, Postings>::iterator it2 = words.find( *it );
+    if( it2 == words.end( ))
+      continue;
+    Postings &postings = it2->second;
+    Postings::iterator it3 = std::lower_bound( postings.begin( ), postings.end( ), event );
+    if( it3 != postings.end( ) and *it3 == event )
+      postings.erase( it3 );
+    if( postings.empty( ))
+      words.erase( it2 );
+  }
+}
+
+void EPGStore::Lookup( const std::string &text, Postings &matches ) const
+{
+  std::set<std::string> query;
+  Tokenize( text, query, 1 );
+
+  bool first = true;
+  for( std::set<std::string>::const_iterator it = query.begin( ); it != query.end( ); it++ )
+  {
+    // union of all words having this prefix
+    Postings hits;
+    std::map<std::string, Postings>::const_iterator it2 = words.lower_bound( *it );
+    for( ; it2 != words.end( ) and it2->first.compare( 0, it->length( ), *it ) == 0; it2++ )
+      hits.insert( hits.end( ), it2->second.begin( ), it2->second.end( ));
+    std::sort( hits.begin( ), hits.end( ));
+    hits.erase( std::unique( hits.begin( ), hits.end( )), hits.end( ));
+
+    if( first )
+    {
+      matches.swap( hits );
+      first = false;
+    }
+    else
+    {
+      Postings t;
+      std::set_intersection( matches.begin( ), matches.end( ), hits.begin( ), hits.end( ), std::back_inserter( t ));
+      matches.swap( t );
+    }
+    if( matches.empty( ))
+      break;
+  }
+}
+
+void EPGStore::Search( const std::string &text, const Channel *channel, time_t from, time_t to, std::vector<Event *> &result ) const
+{
+  Postings t;
+  Lookup( text, t );
+
+  size_t first = result.size( );
+  for( Postings::const_iterator it = t.begin( ); it != t.end( ); it++ )
+  {
+    if( channel and &(*it)->GetChannel( ) != channel )
+      continue;
+    if( (*it)->GetEnd( ) <= from )
+      continue;
+    if( to and (*it)->GetStart( ) >= to )
+      continue;
+    result.push_back( *it );
+  }
+  std::sort( result.begin( ) + first, result.end( ), Sort );
+}
+
+EPGStore::Result::Result( const EPGStore &store ) :
+  lock(store),
+  store(store),
+  i(0)
+{
+}
+
+void EPGStore::Result::NowNext( time_t now, const Channel *channel, const std::string &text )
+{
+  std::vector<Event *> t;
+  store.GetNowNext( now, t );
+  Postings matches;
+  if( !text.empty( ))
+    store.Lookup( text, matches );
+  for( std::vector<Event *>::const_iterator it = t.begin( ); it != t.end( ); it++ )
+  {
+    if( channel and &(*it)->GetChannel( ) != channel )
+      continue;
+    if( !text.empty( ) and !std::binary_search( matches.begin( ), matches.end( ), *it ))
+      continue;
+    events.push_back( *it );
+  }
+}
+
+void EPGStore::Result::Search( const std::string &text, const Channel *channel, time_t from, time_t to )
+{
+  store.Search( text, channel, from, to, events );
+}
+
+const JSONObject *EPGStore::Result::Next( )
+{
+  return i < events.size( ) ? events[i++] : NULL;
+}
+
+int EPGStore::GetCount( ) const
+{
+  SCOPELOCK( );
+  return events.size( );
+}
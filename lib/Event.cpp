@@ -27,11 +27,16 @@
 
 #include <sys/time.h>
 #include <string.h>
+#include <algorithm> // stable_sort
 #include <libdvbv5/eit.h>
 #include <libdvbv5/desc_event_short.h>
 #include <libdvbv5/desc_event_extended.h>
 
-Event::Event( Channel &channel ) : channel(channel)
+Event::Event( Channel &channel ) :
+  channel(channel),
+  version_pf(EVENT_VERSION_UNKNOWN),
+  version_schedule(EVENT_VERSION_UNKNOWN),
+  schedule_table_id(0)
 {
 }
 
@@ -51,15 +56,22 @@ void dvb_escape( std::string &s )
     s = t;
 }
 
-Event::Event( Channel &channel, const struct dvb_table_eit_event *event ) : channel(channel)
+Event::Event( Channel &channel, const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version ) :
+  channel(channel),
+  version_pf(EVENT_VERSION_UNKNOWN),
+  version_schedule(EVENT_VERSION_UNKNOWN),
+  schedule_table_id(0)
 {
   if( !event )
   {
     LogError( "Event::Event event is NULL" ); //FIXME: load stuff in separate method
     return;
   }
+  Update( event, table_id, version );
+}
 
-  id = event->event_id;
+time_t Event::GetStart( const struct dvb_table_eit_event *event )
+{
   struct tm t;
   time_t now;
 
@@ -80,9 +92,40 @@ Event::Event( Channel &channel, const struct dvb_table_eit_event *event ) : chan
   //t.tm_isdst = 0;
   t.tm_hour += gmt_offset / 3600;
 
-  start = mktime( &t );
+  return mktime( &t );
+}
 
+bool Event::IsCurrent( uint8_t table_id, uint8_t version ) const
+{
+  if( table_id == DVB_TABLE_EIT )
+    return version_pf == version;
+  return schedule_table_id == table_id and version_schedule == version;
+}
+
+void Event::Update( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version )
+{
+  id = event->event_id;
+  start = GetStart( event );
   duration = event->duration;
+  if( table_id == DVB_TABLE_EIT )
+    version_pf = version;
+  else
+  {
+    schedule_table_id = table_id;
+    version_schedule = version;
+  }
+
+  name = "";
+  description = "";
+  language = "";
+  description_items.clear( );
+  std::string extended;
+
+  size_t items = 0;
+  for( struct dvb_desc *desc = event->descriptor; desc; desc = desc->next )
+    if( desc->type == extended_event_descriptor )
+      items += ((struct dvb_desc_event_extended *) desc)->num_items;
+  description_items.reserve( items );
 
   bool first = true;
   struct dvb_desc *desc = event->descriptor;
@@ -95,8 +138,7 @@ Event::Event( Channel &channel, const struct dvb_table_eit_event *event ) : chan
           struct dvb_desc_event_short *d = (struct dvb_desc_event_short *) desc;
           if( d->name ) name = d->name;
           if( d->language ) language = (char *) d->language;
-          if( d->text ) description = d->text;
-          if( description == name ) description = "";
+          if( d->text and name.str( ) != d->text ) description = d->text;
         }
         break;
       case content_descriptor:
@@ -108,15 +150,13 @@ Event::Event( Channel &channel, const struct dvb_table_eit_event *event ) : chan
             if (first and d->id != 0)
                 LogError( "description_extended: id not 0" );
 
-            if( d->text ) description_extended += d->text;
+            if( d->text ) extended += d->text;
 
             for( int i = 0; i < d->num_items; i++ )
             {
                 if( ! d->items[i].description)
                     continue;
-                std::vector<std::string> &l = this->description_items[d->items[i].description];
-                std::string t( d->items[i].item );
-                l.push_back( t );
+                description_items.emplace_back( d->items[i].description, d->items[i].item ? d->items[i].item : "" );
             }
         }
         break;
@@ -129,6 +169,8 @@ Event::Event( Channel &channel, const struct dvb_table_eit_event *event ) : chan
     if (first)
         first = false;
   }
+  description_extended = extended;
+  std::stable_sort( description_items.begin( ), description_items.end( ), CompareItems );
 //  printf( "name: %s\n\n", name.c_str( ));
   //LogWarn( "Event %s: %d.%d.%d %d:%d", name.c_str( ), t.tm_mday, t.tm_mon, t.tm_year, t.tm_hour, t.tm_min );
   //localtime_r( &start, &t );
@@ -165,10 +207,7 @@ time_t Event::GetStart( ) const
 
 time_t Event::GetEnd( ) const
 {
-  struct tm t;
-  localtime_r( &start, &t );
-  t.tm_sec += duration;
-  return mktime( &t );
+  return start + duration;
 }
 
 bool Event::SaveConfig( ConfigBase &config )
@@ -176,24 +215,25 @@ bool Event::SaveConfig( ConfigBase &config )
   config.WriteConfig( "EventID",     id );
   config.WriteConfig( "Start",       start );
   config.WriteConfig( "Duration",    duration );
-  config.WriteConfig( "Name",        name );
-  config.WriteConfig( "Description", description );
-  config.WriteConfig( "DescriptionExtended", description_extended );
-  config.WriteConfig( "Language",    language );
+  config.WriteConfig( "Name",        name.str( ));
+  config.WriteConfig( "Description", description.str( ));
+  config.WriteConfig( "DescriptionExtended", description_extended.str( ));
+  config.WriteConfig( "Language",    language.str( ));
 
   config.DeleteConfig( "DescriptionItems" );
   Setting &n = config.ConfigList( "DescriptionItems" );
   ConfigBase c( n );
-  for( std::map<std::string, std::vector<std::string>>::const_iterator it = description_items.begin( ); it != description_items.end( ); it++ )
+  for( std::vector<DescriptionItem>::const_iterator it = description_items.begin( ); it != description_items.end( ); )
   {
     Setting &n2 = c.ConfigList( );
     Setting &n3 = n2.add( Setting::TypeString );
-    n3 = it->first;
-      for( std::vector<std::string>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++ )
-      {
-        Setting &n3 = n2.add( Setting::TypeString );
-        n3 = *it2;
-      }
+    n3 = it->first.str( );
+    const InternedString &key = it->first;
+    for( ; it != description_items.end( ) and it->first == key; it++ )
+    {
+      Setting &n3 = n2.add( Setting::TypeString );
+      n3 = it->second.str( );
+    }
   }
 }
 
@@ -202,25 +242,112 @@ bool Event::LoadConfig( ConfigBase &config )
   config.ReadConfig( "EventID",     id );
   config.ReadConfig( "Start",       start );
   config.ReadConfig( "Duration",    duration );
-  config.ReadConfig( "Name",        name );
-  config.ReadConfig( "Description", description );
-  config.ReadConfig( "DescriptionExtended", description_extended );
-  config.ReadConfig( "Language",    language );
+  std::string t;
+  config.ReadConfig( "Name",        t );
+  name = t;
+  config.ReadConfig( "Description", t );
+  description = t;
+  config.ReadConfig( "DescriptionExtended", t );
+  description_extended = t;
+  config.ReadConfig( "Language",    t );
+  language = t;
 
   Setting &n = config.ConfigList( "DescriptionItems" );
   ConfigBase c2( n );
+  size_t items = 0;
+  for( int i = 0; i < n.getLength( ); i++ )
+    if( n[i].getLength( ) > 1 )
+      items += n[i].getLength( ) - 1;
+  description_items.reserve( items );
   for( int i = 0; i < n.getLength( ); i++ )
   {
       Setting &n2 = n[i];
-      std::string item_desc;
+      InternedString item_desc;
       for( int j = 0; j < n2.getLength( ); j++ )
       {
           if( j == 0 )
               item_desc = n2[j].c_str();
           else
-              description_items[item_desc].push_back(n2[j]);
+              description_items.emplace_back( item_desc, n2[j].c_str( ));
       }
   }
+  std::stable_sort( description_items.begin( ), description_items.end( ), CompareItems );
+}
+
+template <class T> static void Put( std::string &buffer, const T &value )
+{
+  buffer.append((const char *) &value, sizeof( value ));
+}
+
+static void PutString( std::string &buffer, const std::string &s )
+{
+  Put<uint32_t>( buffer, s.length( ));
+  buffer.append( s );
+}
+
+template <class T> static bool Get( const uint8_t *&data, const uint8_t *end, T &value )
+{
+  if( end - data < (ssize_t) sizeof( value ))
+    return false;
+  memcpy( &value, data, sizeof( value ));
+  data += sizeof( value );
+  return true;
+}
+
+static bool GetString( const uint8_t *&data, const uint8_t *end, InternedString &s )
+{
+  uint32_t len;
+  if( !Get( data, end, len ) or (size_t) ( end - data ) < len )
+    return false;
+  s = std::string((const char *) data, len );
+  data += len;
+  return true;
+}
+
+void Event::Pack( std::string &buffer ) const
+{
+  Put<int32_t>( buffer, id );
+  Put<int64_t>( buffer, start );
+  Put<uint32_t>( buffer, duration );
+  Put<uint8_t>( buffer, version_pf );
+  Put<uint8_t>( buffer, version_schedule );
+  Put<uint8_t>( buffer, schedule_table_id );
+  PutString( buffer, name );
+  PutString( buffer, description );
+  PutString( buffer, description_extended );
+  PutString( buffer, language );
+  Put<uint32_t>( buffer, description_items.size( ));
+  for( std::vector<DescriptionItem>::const_iterator it = description_items.begin( ); it != description_items.end( ); it++ )
+  {
+    PutString( buffer, it->first );
+    PutString( buffer, it->second );
+  }
+}
+
+bool Event::Unpack( const uint8_t *&data, const uint8_t *end )
+{
+  int32_t i;
+  int64_t t;
+  uint32_t count;
+  if( !Get( data, end, i ) or !Get( data, end, t ) or !Get( data, end, duration ) or
+      !Get( data, end, version_pf ) or !Get( data, end, version_schedule ) or !Get( data, end, schedule_table_id ))
+    return false;
+  id = i;
+  start = t;
+  if( !GetString( data, end, name ) or !GetString( data, end, description ) or
+      !GetString( data, end, description_extended ) or !GetString( data, end, language ))
+    return false;
+  if( !Get( data, end, count ))
+    return false;
+  description_items.clear( );
+  description_items.reserve( std::min<size_t>( count, end - data ));
+  for( uint32_t j = 0; j < count; j++ )
+  {
+    description_items.emplace_back( );
+    if( !GetString( data, end, description_items.back( ).first ) or !GetString( data, end, description_items.back( ).second ))
+      return false;
+  }
+  return true;
 }
 
 void Event::json( json_object *entry ) const
@@ -234,17 +361,44 @@ void Event::json( json_object *entry ) const
   json_object_object_add( entry, "channel",       json_object_new_string( channel.GetName( ).c_str( )));
   json_object_object_add( entry, "channel_id",    json_object_new_int( channel.GetKey( )));
   json_object *json_desc_items = json_object_new_object( );
-  for( std::map<std::string, std::vector<std::string>>::const_iterator it = description_items.begin( ); it != description_items.end( ); it++ )
+  for( std::vector<DescriptionItem>::const_iterator it = description_items.begin( ); it != description_items.end( ); )
   {
       json_object *json_desc_item = json_object_new_array( );
-      for( std::vector<std::string>::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++ )
-          json_object_array_add( json_desc_item, json_object_new_string(it2->c_str()));
-      json_object_object_add( json_desc_items, it->first.c_str(), json_desc_item);
-
+      const InternedString &key = it->first;
+      for( ; it != description_items.end( ) and it->first == key; it++ )
+          json_object_array_add( json_desc_item, json_object_new_string( it->second.c_str( )));
+      json_object_object_add( json_desc_items, key.c_str( ), json_desc_item );
   }
   json_object_object_add( entry, "description_items", json_desc_items);
 }
 
+void Event::serialize( JSONWriter &writer ) const
+{
+  writer.Add( "name",                 name.str( ));
+  writer.Add( "description",          description.str( ));
+  writer.Add( "description_extended", description_extended.str( ));
+  writer.Add( "id",                   id );
+  writer.AddTime( "start",            start );
+  writer.Add( "duration",             (int) duration );
+  writer.Add( "channel",              channel.GetName( ));
+  writer.Add( "channel_id",           channel.GetKey( ));
+  writer.BeginObject( "description_items" );
+  for( std::vector<DescriptionItem>::const_iterator it = description_items.begin( ); it != description_items.end( ); )
+  {
+    const InternedString &key = it->first;
+    writer.BeginArray( key.c_str( ));
+    for( ; it != description_items.end( ) and it->first == key; it++ )
+      writer.Add( NULL, it->second.str( ));
+    writer.EndArray( );
+  }
+  writer.EndObject( );
+}
+
+bool Event::CompareItems( const DescriptionItem &a, const DescriptionItem &b )
+{
+  return a.first < b.first;
+}
+
 bool Event::compare( const JSONObject &other, const int &p ) const
 {
   const Event &b = (const Event &) other;
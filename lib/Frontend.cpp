@@ -41,7 +41,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
-#include <algorithm> // replace
+#include <algorithm> // replace, min
 #include <RPCObject.h>
 
 #include <libdvbv5/dvb-demux.h>
@@ -49,6 +49,7 @@
 #include <libdvbv5/dvb-scan.h>
 #include <errno.h> // ETIMEDOUT
 #include <sys/time.h>
+#include <sys/ioctl.h>
 
 Frontend::Frontend( Adapter &adapter, std::string name, int adapter_id, int frontend_id, int config_id ) :
   ConfigObject( adapter, "frontend", config_id )
@@ -63,6 +64,7 @@ Frontend::Frontend( Adapter &adapter, std::string name, int adapter_id, int fron
   , current_port(0)
   , state(State_New)
   , usecount( 0 )
+  , fd_status(-1)
   , tune_timeout(5000)
   , up(true)
 {
@@ -84,6 +86,7 @@ Frontend::Frontend( Adapter &adapter, std::string configfile ) :
   , current_port(0)
   , state(State_New)
   , usecount( 0 )
+  , fd_status(-1)
   , up(true)
 {
   StartThread( );
@@ -183,6 +186,10 @@ bool Frontend::Open()
     LogError( "Error opening /dev/dvb/adapter%d/frontend%d", adapter_id, frontend_id );
     return false;
   }
+  // libdvbv5 keeps its handle private, a read only one is enough for the status
+  char dev[64];
+  snprintf( dev, sizeof( dev ), "/dev/dvb/adapter%d/frontend%d", adapter_id, frontend_id );
+  fd_status = open( dev, O_RDONLY | O_NONBLOCK );
   state = State_Opened;
   return true;
 }
@@ -193,6 +200,9 @@ void Frontend::Close()
   {
     //Log( "Closing /dev/dvb/adapter%d/frontend%d", adapter_id, frontend_id );
     dvb_fe_close( fe );
+    if( fd_status >= 0 )
+      close( fd_status );
+    fd_status = -1;
     transponder = NULL;
     fe = NULL;
     state = State_Ready;
@@ -324,62 +334,89 @@ void Frontend::CloseDemux( int fd )
   dvb_dmx_close( fd );
 }
 
-bool Frontend::GetLockStatus( uint8_t &signal, uint8_t &noise, int timeout )
+bool Frontend::ReadStatus( uint32_t &status )
+{
+  if( fd_status >= 0 )
+  {
+    fe_status_t st;
+    if( ioctl( fd_status, FE_READ_STATUS, &st ) == 0 )
+    {
+      status = st;
+      return true;
+    }
+  }
+  if( dvb_fe_get_stats( fe ) != 0 )
+    return false;
+  dvb_fe_retrieve_stats( fe, DTV_STATUS, &status );
+  return true;
+}
+
+bool Frontend::GetLockStatus( uint8_t &signal, uint8_t &noise, int timeout, int carrier_timeout )
 {
   if( !fe )
     return false;
-  uint32_t snr = 0, sig = 0;
-  uint32_t ber = 0, unc = 0;
 
   struct timeval ts;
   gettimeofday( &ts, NULL );
   long start = ts.tv_sec * 1000 + ts.tv_usec / 1000; // milli seconds
 
+  // poll fast while the status changes, slow down while it does not
+  int interval = FE_POLL_MIN;
+  uint32_t last = 0;
   while( state == State_Tuning && up )
   {
-    int r = dvb_fe_get_stats( fe );
-    if( r != 0 )
+    uint32_t status = 0;
+    if( !ReadStatus( status ))
     {
       LogError( "Error getting frontend status" );
       return false;
     }
 
-    uint32_t status = 0;
-    dvb_fe_retrieve_stats( fe, DTV_STATUS, &status );
-	dvb_fe_retrieve_stats( fe, DTV_BER, &ber );
-	dvb_fe_retrieve_stats( fe, DTV_SIGNAL_STRENGTH, &sig );
-	dvb_fe_retrieve_stats( fe, DTV_UNCORRECTED_BLOCKS, &unc );
-	dvb_fe_retrieve_stats( fe, DTV_SNR, &snr );
+    if( status & FE_HAS_LOCK )
+    {
+      uint32_t snr = 0, sig = 0;
+      uint32_t ber = 0, unc = 0;
+      if( dvb_fe_get_stats( fe ) == 0 )
+      {
+        dvb_fe_retrieve_stats( fe, DTV_BER, &ber );
+        dvb_fe_retrieve_stats( fe, DTV_SIGNAL_STRENGTH, &sig );
+        dvb_fe_retrieve_stats( fe, DTV_UNCORRECTED_BLOCKS, &unc );
+        dvb_fe_retrieve_stats( fe, DTV_SNR, &snr );
+      }
       sig *= 100;
       sig /= 0xffff;
       snr *= 100;
       snr /= 0xffff;
-    if( status & FE_HAS_LOCK )
-    {
-
-      //if( i > 0 )
-      //printf( "\n" );
-      Log( "Tuned: sig=%3u%% snr=%3u%% ber=%d unc=%d", (unsigned int) sig, (unsigned int) snr, ber, unc );
 
-      //Log( "Tuned: sig=%3u%% snr=%3u%% ber=%d unc=%d", (unsigned int) sig, (unsigned int) snr, ber, unc );
+      gettimeofday( &ts, NULL );
+      Log( "Tuned in %ld ms: sig=%3u%% snr=%3u%% ber=%d unc=%d", ( ts.tv_sec * 1000 + ts.tv_usec / 1000 ) - start,
+           (unsigned int) sig, (unsigned int) snr, ber, unc );
 
       signal = sig;
       noise  = snr;
       return true;
     }
-    else
-      Log( "Tuned: sig=%3u%% snr=%3u%% ber=%d unc=%d", (unsigned int) sig, (unsigned int) snr, ber, unc );
+
+    if( status != last )
+    {
+      last = status;
+      interval = FE_POLL_MIN;
+    }
 
     struct timeval ts2;
     gettimeofday( &ts2, NULL );
 
-    if(( ts2.tv_sec * 1000 + ts2.tv_usec / 1000 ) - start > timeout )
+    long elapsed = ( ts2.tv_sec * 1000 + ts2.tv_usec / 1000 ) - start;
+    if( elapsed > timeout )
       break;
-    usleep( 100000 );
-    //printf( "." );
-    //fflush( stdout );
+    if( carrier_timeout > 0 and elapsed > carrier_timeout and !( status & ( FE_HAS_SIGNAL | FE_HAS_CARRIER )))
+    {
+      Log( "No carrier" );
+      break;
+    }
+    usleep( interval * 1000 );
+    interval = std::min( interval * 2, FE_POLL_MAX );
   }
-  //printf( "\n" );
   return false;
 }
 
@@ -419,7 +456,12 @@ bool Frontend::Tune( Transponder &t )
   Log( "Tuning %s", t.toString( ).c_str( ));
 
   uint8_t signal, noise;
-  int r = dvb_set_compat_delivery_system( fe, t.GetDelSys( ));
+  bool cached;
+  int r;
+  Transponder::State failed = Transponder::State_TuningFailed;
+
+retune:
+  r = dvb_set_compat_delivery_system( fe, t.GetDelSys( ));
   if( r != 0 )
   {
     LogError( "dvb_set_compat_delivery_system return %d", r );
@@ -427,14 +469,22 @@ bool Frontend::Tune( Transponder &t )
   }
 
   SetTuneParams( t );
-  t.GetParams( fe );
-  dvb_estimate_freq_shift( fe );
+  t.GetParams( fe ); // also sets polarization and inversion, which are not cached
+  // known transponders are tuned with the parameters of their last lock
+  cached = t.ApplyTuneCache( GetCurrentPort( ), fe );
+  if( !cached )
+    dvb_estimate_freq_shift( fe );
 
   r = dvb_fe_set_parms( fe );
   if( r != 0 )
   {
     LogError( "dvb_fe_set_parms failed with %d.", r );
     dvb_fe_prt_parms( fe );
+    if( cached )
+    {
+      t.ClearTuneCache( );
+      goto retune;
+    }
     goto fail;
   }
   //dvb_fe_prt_parms( fe );
@@ -442,22 +492,27 @@ bool Frontend::Tune( Transponder &t )
 	/* As the DVB core emulates it, better to always use auto */
 	dvb_fe_store_parm(fe, DTV_INVERSION, INVERSION_AUTO);
 
-	uint32_t freq;
-	dvb_fe_retrieve_parm(fe, DTV_FREQUENCY, &freq);
-	//dvb_fe_prt_parms(fe);
-
-  if( !GetLockStatus( signal, noise, tune_timeout ))
+  if( !GetLockStatus( signal, noise, tune_timeout, t.IsProbe( ) ? BLIND_SCAN_CARRIER_TIMEOUT : 0 ))
   {
+    if( cached )
+    {
+      LogWarn( "Tuning with cached parameters failed, retrying with AUTO" );
+      t.ClearTuneCache( );
+      goto retune;
+    }
     LogError( "Tuning failed" );
+    failed = Transponder::State_NoSignal;
     goto fail;
   }
+  if( !cached )
+    t.UpdateTuneCache( GetCurrentPort( ), fe );
 
   t.SetState( Transponder::State_Tuned );
   t.SetSignal( signal, noise );
   return true;
 
 fail:
-  t.SetState( Transponder::State_TuningFailed );
+  t.SetState( failed );
   t.SaveConfig( );
   Release( );
   return false;
@@ -499,6 +554,10 @@ void Frontend::json( json_object *entry ) const
     json_object_array_add( a, entry );
   }
   json_object_object_add( entry, "ports", a );
+
+  json_object *ts = json_object_new_object( );
+  monitor.json( ts );
+  json_object_object_add( entry, "ts", ts );
 }
 
 bool Frontend::RPC( const HTTPRequest &request, const std::string &cat, const std::string &action )
@@ -513,7 +572,8 @@ bool Frontend::RPC( const HTTPRequest &request, const std::string &cat, const st
     std::map<int, Port *>::iterator it = ports.find( port_id );
     if( it == ports.end( ))
     {
-      LogError( "Port %d not found", port_id );
+      UnlockPorts( );
+      request.NotFound( "Port %d not found", port_id );
       return false;
     }
     bool ret = it->second->RPC( request, cat, action );
@@ -561,15 +621,15 @@ bool Frontend::RPC( const HTTPRequest &request, const std::string &cat, const st
     std::map<int, Port *>::iterator it = ports.find( port_id );
     if( it == ports.end( ))
     {
-      LogError( "Port not found: %d", port_id );
       UnlockPorts( );
+      request.NotFound( "Port not found: %d", port_id );
       return false;
     }
     it->second->Delete( );
     delete it->second;
     ports.erase( it );
     UnlockPorts( );
-
+    request.Reply( HTTP_OK );
     return true;
   }
 
@@ -614,7 +674,7 @@ void Frontend::Run( )
           activity_lock.Unlock( );
           state = State_ScanEPG;
         }
-        break;
+        continue; // nothing to scan, look for EPG right away
 
       case State_ScanEPG:
         {
@@ -628,6 +688,7 @@ void Frontend::Run( )
               activity_lock.Unlock( );
               act->Run( );
               idle = false;
+              state = State_Ready; // pending scans go first
               break;
             }
           }
@@ -127,12 +127,13 @@ bool Frontend_DVBC::HandleNIT( struct dvb_table_nit *nit )
           break;
       }
       Source &source = transponder->GetSource( );
+      ScopeLock _l( source );
       Transponder_DVBC *t = new Transponder_DVBC( source,
                                                   desc->frequency,
                                                   desc->symbol_rate,
                                                   fec,
                                                   modulation,
-                                                  source.GetTransponderCount( ));
+                                                  source.GetAvailableTransponderKey( ));
       if( !source.AddTransponder( t ))
         delete t;
       else
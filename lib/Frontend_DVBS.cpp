@@ -191,6 +191,7 @@ bool Frontend_DVBS::HandleNIT( struct dvb_table_nit *nit )
       }
 
       Source &source = transponder->GetSource( );
+      ScopeLock _l( source );
       Transponder_DVBS *t = new Transponder_DVBS( source,
                                                   delsys,
                                                   desc->frequency,
@@ -199,7 +200,7 @@ bool Frontend_DVBS::HandleNIT( struct dvb_table_nit *nit )
                                                   fec,
                                                   modulation,
                                                   rolloff,
-                                                  source.GetTransponderCount( ));
+                                                  source.GetAvailableTransponderKey( ));
       if( !source.AddTransponder( t ))
         delete t;
       else
@@ -21,7 +21,11 @@
 
 #include "Frontend_DVBT.h"
 
+#include <libdvbv5/nit.h>
+#include <libdvbv5/desc_terrestrial_delivery.h>
+
 #include "Log.h"
+#include "Transponder_DVBT.h"
 #include "Adapter.h"
 
 Frontend_DVBT::Frontend_DVBT( Adapter &adapter, std::string name, int adapter_id, int frontend_id, int config_id ) :
@@ -54,111 +58,136 @@ bool Frontend_DVBT::LoadConfig( )
 
 bool Frontend_DVBT::HandleNIT( struct dvb_table_nit *nit )
 {
-  //struct section_ext *section_ext = NULL;
-  //if(( section_ext = section_ext_decode( section, 1 )) == NULL )
-  //{
-    //printf( "unable to extract section_ext of nit\n" );
-    //return false;
-  //}
-  //struct dvb_nit_section *nit = dvb_nit_section_codec(section_ext);
-  //if( nit == NULL )
-  //{
-    //printf( "NIT section decode error\n" );
-    //return false;
-  //}
-  //struct descriptor *curd = NULL;
-  //dvb_nit_section_descriptors_for_each(nit, curd)
-  //{
-    //if( curd->tag == dtag_dvb_cell_list)
-    //{
-      //struct dvb_cell_list_descriptor *dx = dvb_cell_list_descriptor_codec(curd);
-      //if( dx == NULL )
-        //return false;
-      //struct dvb_cell_list_entry *entry = NULL;
-      //dvb_cell_list_descriptor_cells_for_each(dx, entry)
-      //{
-        //printf( "Cell %d info: lat %i, long %i, ext_lat %i, ext_long %i\n",
-            //entry->cell_id, entry->cell_latitude, entry->cell_longitude,
-            //entry->cell_extend_of_latitude, entry->cell_extend_of_longitude );
-        //struct dvb_subcell_list_entry *cur_subcell = NULL;
-        //dvb_cell_list_entry_subcells_for_each(entry, cur_subcell)
-        //{
-          //printf( "Subcell %d info: lat %i, long %i, ext_lat %i, ext_long %i\n",
-              //cur_subcell->cell_id_extension, cur_subcell->subcell_latitude, cur_subcell->subcell_longitude,
-              //cur_subcell->subcell_extend_of_latitude, cur_subcell->subcell_extend_of_longitude );
-        //}
-      //}
-    //}
-  //}
-  //struct dvb_nit_section_part2 *part2 = dvb_nit_section_part2(nit);
-  //struct dvb_nit_transport *cur_transport = NULL;
-  //dvb_nit_section_transports_for_each(nit, part2, cur_transport)
-  //{
-    //dvb_nit_transport_descriptors_for_each(cur_transport, curd)
-    //{
-      //switch( curd->tag )
-      //{
-        //case dtag_dvb_terrestial_delivery_system:
-          //{
-            //struct dvb_terrestrial_delivery_descriptor *dx = dvb_terrestrial_delivery_descriptor_codec(curd);
-            //if( dx == NULL )
-              //return false;
-            //printf( "TS centre_frequency:%x bandwidth:%x priority:%i "
-                //"time_slicing_indicator:%i mpe_fec_indicator:%i constellation:%i "
-                //"hierarchy_information:%i code_rate_hp_stream:%i "
-                //"code_rate_lp_stream:%i guard_interval:%i transmission_mode:%i "
-                //"other_frequency_flag:%i\n",
-                //dx->centre_frequency, dx->bandwidth, dx->priority,
-                //dx->time_slicing_indicator, dx->mpe_fec_indicator,
-                //dx->constellation,
-                //dx->hierarchy_information, dx->code_rate_hp_stream,
-                //dx->code_rate_lp_stream, dx->guard_interval,
-                //dx->transmission_mode, dx->other_frequency_flag );
-          //}
-          //break;
-        //case dtag_dvb_frequency_list:
-          //{
-            //struct dvb_frequency_list_descriptor *dx = dvb_frequency_list_descriptor_codec(curd);
-            //if( dx == NULL )
-              //return false;
-            //printf( "FREQ list type coding %x\n", dx->coding_type );
-            //uint32_t *freqs = dvb_frequency_list_descriptor_centre_frequencies(dx);
-            //int count = dvb_frequency_list_descriptor_centre_frequencies_count(dx);;
-            //for( int iCount = 0; iCount < count; ++iCount)
-            //{
-              //printf( "DVB freq found: %d\n",freqs[iCount] );
-            //}
-          //}
-          //break;
-        //case dtag_dvb_cell_frequency_link:
-          //{
-            //struct dvb_cell_frequency_link_descriptor *dx = dvb_cell_frequency_link_descriptor_codec(curd);
-            //if( dx == NULL )
-              //return false;
-            //struct dvb_cell_frequency_link_cell *cur = NULL;
-            //struct dvb_cell_frequency_link_cell_subcell *cur_subcell = NULL;
-
-            //dvb_cell_frequency_link_descriptor_cells_for_each(dx, cur) {
-              //printf("FREQ cell_id:%04x frequency:%i\n", cur->cell_id, cur->frequency);
-
-              //dvb_cell_frequency_link_cell_subcells_for_each(cur, cur_subcell) {
-                //printf("FREQ cell_id_extension:%04x transponder_frequency:%i\n", cur_subcell->cell_id_extension, cur_subcell->transposer_frequency);
-              //}
-            //}
-
-          //}
-          //break;
-      //}
-    //}
-  //}
-
-  //// switch to the SDT table
-  //filter[0] = stag_dvb_service_description_actual;
-  //if( dvbdemux_set_section_filter( fd_demux, TRANSPORT_SDT_PID, filter, mask, 1, 1 ))
-  //{
-    //printf( "failed to set demux filter for sdt\n" );
-    //up = false;
-    //return false;
-  //}
+  dvb_nit_transport_foreach( tr, nit )
+  {
+    dvb_desc_find( struct dvb_desc_terrestrial_delivery, desc, tr, terrestrial_delivery_system_descriptor )
+    {
+      if( desc->centre_frequency == 0 )
+      {
+        LogWarn( "  NIT terrestrial descriptor frequency 0 ignored" );
+        continue;
+      }
+      uint32_t frequency = desc->centre_frequency * 10; // 10 Hz units
+
+      int bandwidth = 0;
+      switch( desc->bandwidth )
+      {
+        case 0:
+          bandwidth = 8000000;
+          break;
+        case 1:
+          bandwidth = 7000000;
+          break;
+        case 2:
+          bandwidth = 6000000;
+          break;
+        case 3:
+          bandwidth = 5000000;
+          break;
+      }
+
+      fe_modulation modulation = QAM_AUTO;
+      switch( desc->constellation )
+      {
+        case 0:
+          modulation = QPSK;
+          break;
+        case 1:
+          modulation = QAM_16;
+          break;
+        case 2:
+          modulation = QAM_64;
+          break;
+      }
+
+      fe_code_rate code_rate_HP = CodeRate( desc->code_rate_hp_stream );
+      fe_code_rate code_rate_LP = CodeRate( desc->code_rate_lp_stream );
+
+      fe_guard_interval guard_interval = GUARD_INTERVAL_AUTO;
+      switch( desc->guard_interval )
+      {
+        case 0:
+          guard_interval = GUARD_INTERVAL_1_32;
+          break;
+        case 1:
+          guard_interval = GUARD_INTERVAL_1_16;
+          break;
+        case 2:
+          guard_interval = GUARD_INTERVAL_1_8;
+          break;
+        case 3:
+          guard_interval = GUARD_INTERVAL_1_4;
+          break;
+      }
+
+      fe_transmit_mode transmission_mode = TRANSMISSION_MODE_AUTO;
+      switch( desc->transmission_mode )
+      {
+        case 0:
+          transmission_mode = TRANSMISSION_MODE_2K;
+          break;
+        case 1:
+          transmission_mode = TRANSMISSION_MODE_8K;
+          break;
+        case 2:
+          transmission_mode = TRANSMISSION_MODE_4K;
+          break;
+      }
+
+      fe_hierarchy hierarchy = HIERARCHY_AUTO;
+      switch( desc->hierarchy_information & 0x03 ) // bit 2: in-depth interleaver
+      {
+        case 0:
+          hierarchy = HIERARCHY_NONE;
+          break;
+        case 1:
+          hierarchy = HIERARCHY_1;
+          break;
+        case 2:
+          hierarchy = HIERARCHY_2;
+          break;
+        case 3:
+          hierarchy = HIERARCHY_4;
+          break;
+      }
+
+      Source &source = transponder->GetSource( );
+      ScopeLock _l( source );
+      Transponder_DVBT *t = new Transponder_DVBT( source,
+                                                  SYS_DVBT,
+                                                  frequency,
+                                                  bandwidth,
+                                                  code_rate_HP,
+                                                  code_rate_LP,
+                                                  modulation,
+                                                  transmission_mode,
+                                                  guard_interval,
+                                                  hierarchy,
+                                                  source.GetAvailableTransponderKey( ));
+      if( !source.AddTransponder( t ))
+        delete t;
+      else
+        Log( "  Added transponder %s", t->toString( ).c_str( ));
+    }
+  }
+
   return true;
 }
+
+fe_code_rate Frontend_DVBT::CodeRate( uint8_t code_rate )
+{
+  switch( code_rate )
+  {
+    case 0:
+      return FEC_1_2;
+    case 1:
+      return FEC_2_3;
+    case 2:
+      return FEC_3_4;
+    case 3:
+      return FEC_5_6;
+    case 4:
+      return FEC_7_8;
+  }
+  return FEC_AUTO;
+}
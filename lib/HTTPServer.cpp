@@ -22,12 +22,18 @@
 #include <stdlib.h> // atoi
 #include <arpa/inet.h> // inet_ntop
 #include <math.h> // isnan
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <zlib.h>
 
 #include "StreamingHandler.h" // FIXME: mm.. needed?
 
 static const struct http_status response_status[] = {
   { HTTP_OK, "OK" },
   { HTTP_REDIRECT, "Redirect" },
+  { HTTP_NOT_MODIFIED, "Not Modified" },
   { HTTP_BAD_REQUEST, "Bad Request" },
   { HTTP_UNAUTHORIZED, "Unauthorized" },
   { HTTP_FORBIDDEN, "Forbidden" },
@@ -62,6 +68,10 @@ HTTPServer::HTTPServer( const char *root ) : SocketHandler( ), _root(root), rtsp
   methods["TEARDOWN"] = &HTTPServer::TEARDOWN;
 
   session_timeout = 60;
+  file_cache_size = 0;
+
+  SetIdleTimeout( HTTP_KEEPALIVE_TIMEOUT );
+  SetMaxClients( HTTP_MAX_CONNECTIONS );
 }
 
 HTTPServer::~HTTPServer( )
@@ -74,18 +84,26 @@ void HTTPServer::Connected( int client )
 
 void HTTPServer::Disconnected( int client, bool error )
 {
-  if( _requests.find( client ) != _requests.end( ))
+  Lock( );
+  std::map<int, HTTPRequest *>::iterator it = _requests.find( client );
+  if( it != _requests.end( ))
   {
-    delete _requests[client];
-    _requests.erase( client );
+    delete it->second;
+    _requests.erase( it );
   }
+  Unlock( );
 }
 
 SocketHandler::Message *HTTPServer::CreateMessage( int client ) const
 {
+  int content_length = -1;
+  Lock( );
   std::map<int, HTTPRequest *>::const_iterator it = _requests.find( client );
-  if( it != _requests.end( ) && it->second->content_length != -1 )
-    return new HTTPServer::Message( it->second->content_length );
+  if( it != _requests.end( ))
+    content_length = it->second->content_length;
+  Unlock( );
+  if( content_length != -1 )
+    return new HTTPServer::Message( content_length );
   return new SocketHandler::Message( );
 }
 
@@ -108,14 +126,20 @@ void HTTPServer::HandleMessage( const int client, const SocketHandler::Message &
   //const char *buffer = msg.getLine( ).c_str( );
   //int length = msg.getLine( ).length( );
   //LogWarn( "Got: '%s' from client %d", msg.getLine( ).c_str( ), client );
+  // requests are handled by several workers, but each client by only one at a time
   HTTPRequest *request = NULL;
-  if( _requests.find( client ) == _requests.end( ))
+  Lock( );
+  std::map<int, HTTPRequest *>::iterator it = _requests.find( client );
+  if( it != _requests.end( ))
+    request = it->second;
+  Unlock( );
+  if( !request )
   {
     request = new HTTPRequest( *this, client ); // freed on disconnect
+    Lock( );
     _requests[client] = request;
+    Unlock( );
   }
-  else
-    request = _requests[client];
 
   if( msg.getLine( ).empty( ))
   {
@@ -134,7 +158,9 @@ void HTTPServer::HandleMessage( const int client, const SocketHandler::Message &
 
     if( request->content_length <= 0 || request->content.length( ) == request->content_length ) // FIXME: handle on top
     {
-      if( !HandleRequest( *request ) or !request->KeepAlive( ))
+      // failed requests are answered too, the connection stays usable
+      HandleRequest( *request );
+      if( !request->Replied( ) or !request->KeepAlive( ))
         DisconnectClient( client );
       else
         request->Reset( );
@@ -153,7 +179,8 @@ void HTTPServer::HandleMessage( const int client, const SocketHandler::Message &
       return;
     }
 
-    if( !HandleRequest( *request ) or !request->KeepAlive( ))
+    HandleRequest( *request );
+    if( !request->Replied( ) or !request->KeepAlive( ))
       DisconnectClient( client );
     else
       request->Reset( );
@@ -221,6 +248,25 @@ bool HTTPServer::HandleRequest( HTTPRequest &request )
     inet_ntop( AF_INET, &addr, ipaddr, sizeof( ipaddr ));
 
     Log( "HTTP request %s %s %s", ipaddr, request.http_method.c_str( ), request.url.c_str( ));
+
+    // RTSP methods decide on their own, RTSP connections do not time out
+    if( request.http_version.compare( 0, 5, "HTTP/" ) == 0 )
+    {
+      std::string connection;
+      if( request.HasHeader( "Connection" ))
+      {
+        std::string value;
+        request.GetHeader( "Connection", value );
+        Utils::ToLower( Utils::Trim( value ), connection );
+      }
+      if( request.http_version == "HTTP/1.0" )
+        request.KeepAlive( connection == "keep-alive" );
+      else
+        request.KeepAlive( connection != "close" );
+    }
+    else
+      SetClientTimeout( request.client, 0 );
+
     return (this->*it->second)( request );
   }
 
@@ -300,11 +346,15 @@ bool HTTPServer::GET( HTTPRequest &request )
   else
     filename = url;
 
-  std::ifstream file;
-  file.open( filename.c_str( ), std::ifstream::in );
-  if( !file.is_open( ))
+  return ServeFile( request, filename );
+}
+
+bool HTTPServer::ServeFile( HTTPRequest &request, const std::string &filename )
+{
+  struct stat st;
+  if( stat( filename.c_str( ), &st ) != 0 || !S_ISREG( st.st_mode ))
   {
-    LogError( "HTTPServer: file not found: %s", url.c_str( ));
+    LogError( "HTTPServer: file not found: %s", filename.c_str( ));
     Response err_response;
     err_response.AddStatus( HTTP_NOT_FOUND );
     err_response.AddTimeStamp( );
@@ -315,30 +365,263 @@ bool HTTPServer::GET( HTTPRequest &request )
     return false;
   }
 
-  //Log( "HTTPServer: serving: %s", url.c_str( ));
-  std::string file_contents;
-
-  file.seekg( 0, std::ios::end );
-  file_contents.reserve( file.tellg( ));
-  file.seekg( 0, std::ios::beg );
-
-  file_contents.assign((std::istreambuf_iterator<char>( file )), std::istreambuf_iterator<char>( ));
-  file.close( );
-
   std::string basename = Utils::BaseName( filename.c_str( ));
   std::string extension = Utils::GetExtension( basename );
+  bool compressible = IsCompressible( extension );
+
+  // the gzip variant is a different representation and needs its own tag
+  char etag[64], etag_gzip[64];
+  snprintf( etag, sizeof( etag ), "\"%lx-%lx-%lx\"", (unsigned long) st.st_ino, (unsigned long) st.st_mtime, (unsigned long) st.st_size );
+  snprintf( etag_gzip, sizeof( etag_gzip ), "\"%lx-%lx-%lx-gz\"", (unsigned long) st.st_ino, (unsigned long) st.st_mtime, (unsigned long) st.st_size );
+
+  std::string match;
+  if( request.HasHeader( "If-None-Match" ) && request.GetHeader( "If-None-Match", match ) && ( match == etag || match == etag_gzip ))
+  {
+    Response response;
+    response.AddStatus( HTTP_NOT_MODIFIED );
+    response.AddTimeStamp( );
+    response.AddHeader( "ETag", "%s", match.c_str( ));
+    request.Reply( response );
+    return true;
+  }
 
   Response response;
   response.AddStatus( HTTP_OK );
   response.AddTimeStamp( );
   response.AddMime( extension.c_str( ));
-  response.AddContent( file_contents );
-  //LogWarn( "Sending %s", response->GetBuffer( ).c_str( ));
+  response.AddHeader( "Cache-Control", "no-cache" ); // revalidate using the ETag
+  if( compressible )
+    response.AddHeader( "Vary", "Accept-Encoding" );
+
+  if( st.st_size > HTTP_CACHE_FILE_MAX )
+  {
+    int fd = open( filename.c_str( ), O_RDONLY );
+    if( fd < 0 )
+    {
+      LogError( "HTTPServer: cannot open %s", filename.c_str( ));
+      request.Reply( HTTP_INTERNAL_SRV_ERROR );
+      return false;
+    }
+    response.AddHeader( "ETag", "%s", etag );
+    bool ret = request.ReplyFile( response, fd, st.st_size );
+    close( fd );
+    return ret;
+  }
+
+  bool gzip = compressible && request.AcceptsGzip( );
+
+  file_cache_mutex.Lock( );
+  std::map<std::string, CachedFile>::iterator it = file_cache.find( filename );
+  if( it != file_cache.end( ) && it->second.mtime == st.st_mtime && it->second.size == st.st_size )
+  {
+    if( gzip && !it->second.gzip.empty( ))
+    {
+      response.AddHeader( "ETag", "%s", etag_gzip );
+      response.AddHeader( "Content-Encoding", "gzip" );
+      response.AddContent( it->second.gzip );
+    }
+    else
+    {
+      response.AddHeader( "ETag", "%s", etag );
+      response.AddContent( it->second.content );
+    }
+    file_cache_mutex.Unlock( );
+    request.Reply( response );
+    return true;
+  }
+  file_cache_mutex.Unlock( );
+
+  CachedFile file;
+  if( !LoadFile( filename, st, file ))
+  {
+    request.Reply( HTTP_INTERNAL_SRV_ERROR );
+    return false;
+  }
+  if( gzip && !file.gzip.empty( ))
+  {
+    response.AddHeader( "ETag", "%s", etag_gzip );
+    response.AddHeader( "Content-Encoding", "gzip" );
+    response.AddContent( file.gzip );
+  }
+  else
+  {
+    response.AddHeader( "ETag", "%s", etag );
+    response.AddContent( file.content );
+  }
+  StoreFile( filename, file );
 
   request.Reply( response );
   return true;
 }
 
+bool HTTPServer::LoadFile( const std::string &filename, const struct stat &st, CachedFile &file )
+{
+  if( !ReadFile( filename, st, file.content ))
+    return false;
+  file.mtime = st.st_mtime;
+  file.size = st.st_size;
+  file.gzip.clear( );
+
+  std::string basename = Utils::BaseName( filename.c_str( ));
+  std::string extension = Utils::GetExtension( basename );
+  if( file.content.size( ) >= HTTP_COMPRESS_MIN && IsCompressible( extension ))
+  {
+    if( !Compress( file.content, file.gzip ) || file.gzip.size( ) >= file.content.size( ))
+      file.gzip.clear( );
+  }
+  return true;
+}
+
+void HTTPServer::StoreFile( const std::string &filename, CachedFile &file )
+{
+  ScopeLock _l( file_cache_mutex );
+  std::map<std::string, CachedFile>::iterator it = file_cache.find( filename );
+  if( it != file_cache.end( ))
+  {
+    file_cache_size -= it->second.content.size( ) + it->second.gzip.size( );
+    file_cache.erase( it );
+  }
+  size_t size = file.content.size( ) + file.gzip.size( );
+  if( file_cache_size + size > HTTP_CACHE_MAX )
+    return;
+  CachedFile &cached = file_cache[filename];
+  cached.content.swap( file.content );
+  cached.gzip.swap( file.gzip );
+  cached.mtime = file.mtime;
+  cached.size = file.size;
+  file_cache_size += size;
+}
+
+// fills the file cache with the web UI, compressing its text assets once
+void HTTPServer::PreloadFiles( )
+{
+  std::string root = _root;
+  Utils::EnsureSlash( root );
+  root = Utils::Expand( root.c_str( ));
+  int count = PreloadDir( root );
+  Log( "HTTPServer: preloaded %d files (%lu bytes)", count, (unsigned long) file_cache_size );
+}
+
+int HTTPServer::PreloadDir( const std::string &dir )
+{
+  DIR *d = opendir( dir.c_str( ));
+  if( !d )
+    return 0;
+
+  int count = 0;
+  struct dirent *de;
+  while(( de = readdir( d )) != NULL )
+  {
+    if( de->d_name[0] == '.' )
+      continue;
+    std::string filename = dir + de->d_name;
+    struct stat st;
+    if( stat( filename.c_str( ), &st ) != 0 )
+      continue;
+    if( S_ISDIR( st.st_mode ))
+    {
+      count += PreloadDir( filename + "/" );
+      continue;
+    }
+    if( !S_ISREG( st.st_mode ) || st.st_size > HTTP_CACHE_FILE_MAX )
+      continue;
+
+    CachedFile file;
+    if( LoadFile( filename, st, file ))
+    {
+      StoreFile( filename, file );
+      count++;
+    }
+  }
+  closedir( d );
+  return count;
+}
+
+static pthread_key_t compressor_key;
+static pthread_once_t compressor_once = PTHREAD_ONCE_INIT;
+
+static void FreeCompressor( void *ptr )
+{
+  z_stream *z = (z_stream *) ptr;
+  deflateEnd( z );
+  delete z;
+}
+
+static void CreateCompressorKey( )
+{
+  pthread_key_create( &compressor_key, FreeCompressor );
+}
+
+// gzip, using a compressor kept per thread so workers do not set up zlib for every response
+bool HTTPServer::Compress( const std::string &data, std::string &compressed )
+{
+  pthread_once( &compressor_once, CreateCompressorKey );
+  z_stream *z = (z_stream *) pthread_getspecific( compressor_key );
+  if( !z )
+  {
+    z = new z_stream;
+    memset( z, 0, sizeof( z_stream ));
+    if( deflateInit2( z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16 /* gzip */, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    {
+      LogError( "HTTPServer: cannot initialize zlib" );
+      delete z;
+      return false;
+    }
+    pthread_setspecific( compressor_key, z );
+  }
+  else
+    deflateReset( z );
+
+  compressed.resize( deflateBound( z, data.size( )));
+  z->next_in   = (Bytef *) data.data( );
+  z->avail_in  = data.size( );
+  z->next_out  = (Bytef *) &compressed[0];
+  z->avail_out = compressed.size( );
+  if( deflate( z, Z_FINISH ) != Z_STREAM_END )
+  {
+    compressed.clear( );
+    return false;
+  }
+  compressed.resize( z->total_out );
+  return true;
+}
+
+bool HTTPServer::IsCompressible( const std::string &extension )
+{
+  for( size_t i = 0; i < sizeof( mime_types ) / sizeof( mime_type ); i++ )
+    if( extension == mime_types[i].extension )
+      return !mime_types[i].binary;
+  return false;
+}
+
+bool HTTPServer::ReadFile( const std::string &filename, const struct stat &st, std::string &content )
+{
+  int fd = open( filename.c_str( ), O_RDONLY );
+  if( fd < 0 )
+  {
+    LogError( "HTTPServer: cannot open %s", filename.c_str( ));
+    return false;
+  }
+  content.resize( st.st_size );
+  size_t pos = 0;
+  while( pos < content.size( ))
+  {
+    ssize_t n = read( fd, &content[pos], content.size( ) - pos );
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n <= 0 )
+      break;
+    pos += n;
+  }
+  close( fd );
+  if( pos != content.size( ))
+  {
+    LogError( "HTTPServer: error reading %s", filename.c_str( ));
+    return false;
+  }
+  return true;
+}
+
 bool HTTPServer::POST( HTTPRequest &request )
 {
   std::vector<std::string> params;
@@ -745,7 +1028,7 @@ bool HTTPServer::TEARDOWN( HTTPRequest &request )
   return true;
 }
 
-HTTPServer::Response::Response( ) : header_closed(false)
+HTTPServer::Response::Response( ) : content_length(-1), has_body(true), header_closed(false)
 {
 }
 
@@ -753,10 +1036,14 @@ HTTPServer::Response::~Response( )
 {
 }
 
+// closes the header; every response is framed by Content-Length so the
+// connection can be kept open
 void HTTPServer::Response::Finalize( )
 {
   if( !header_closed )
   {
+    if( has_body )
+      AddHeader( "Content-Length", "%lu", (unsigned long) ( content_length >= 0 ? content_length : _content.size( )));
     _buffer.append( "\r\n" );
     header_closed = true;
   }
@@ -778,6 +1065,7 @@ void HTTPServer::Response::AddStatus( HTTPStatus status )
 
   snprintf( tmp, sizeof( tmp ), "%s %d %s\r\n", HTTP_VERSION, status, response_status[pos].description );
   _buffer.append( tmp );
+  has_body = status != HTTP_NOT_MODIFIED;
 }
 
 void HTTPServer::Response::AddStatus( RTSPStatus status )
@@ -824,21 +1112,21 @@ void HTTPServer::Response::AddHeader( const char *header, const char *fmt, ... )
 void HTTPServer::Response::FreeResponseBuffer( )
 {
   _buffer.clear( );
+  _content.clear( );
 }
 
-void HTTPServer::Response::AddContent( std::string buffer )
+void HTTPServer::Response::AddContent( const std::string &buffer )
 {
-  size_t length = buffer.size( );
-  char length_str[10];
-  snprintf( length_str, sizeof( length_str ), "%d", (int) length );
-
-  AddHeader( "Content-Length", "%s", length_str );
+  _content = buffer;
+}
 
-  Finalize( );
-  _buffer += buffer;
+// for content sent separately, i.e. with sendfile( )
+void HTTPServer::Response::AddContentLength( size_t length )
+{
+  content_length = length;
 }
 
-std::string HTTPServer::Response::GetBuffer( ) const
+const std::string &HTTPServer::Response::GetBuffer( ) const
 {
   return _buffer;
 }
@@ -868,6 +1156,9 @@ void HTTPRequest::Reset( )
   headers.clear( );
   parameters.clear( );
   content = "";
+  content_length = -1;
+  keep_alive = false;
+  replied = false;
 }
 
 void HTTPRequest::NotFound( const char *fmt, ... ) const
@@ -885,6 +1176,35 @@ void HTTPRequest::NotFound( const char *fmt, ... ) const
   Reply( response );
 }
 
+bool HTTPRequest::AcceptsGzip( ) const
+{
+  std::map<std::string, std::string>::const_iterator it = headers.find( "Accept-Encoding" );
+  if( it == headers.end( ))
+    return false;
+
+  std::vector<std::string> codings;
+  Utils::Tokenize( it->second, ",", codings );
+  for( size_t i = 0; i < codings.size( ); i++ )
+  {
+    std::vector<std::string> params;
+    Utils::Tokenize( codings[i], ";", params );
+    if( params.empty( ))
+      continue;
+    std::string coding;
+    Utils::ToLower( Utils::Trim( params[0] ), coding );
+    if( coding != "gzip" && coding != "*" )
+      continue;
+    if( params.size( ) > 1 ) // "gzip;q=0" refuses gzip
+    {
+      std::string q = Utils::Trim( params[1] );
+      if( q.compare( 0, 2, "q=" ) == 0 && atof( q.c_str( ) + 2 ) <= 0.0 )
+        return false;
+    }
+    return true;
+  }
+  return false;
+}
+
 bool HTTPRequest::GetHeader( const char *key, std::string &value ) const
 {
   const std::map<std::string, std::string>::const_iterator p = headers.find( std::string( key ));
@@ -941,8 +1261,37 @@ bool HTTPRequest::HasParam( const char *key ) const
 
 void HTTPRequest::Reply( HTTPServer::Response &response ) const
 {
+  // on a persistent connection a second response would answer the
+  // client's next request
+  if( replied )
+  {
+    LogWarn( "HTTPServer: dropping second reply to %s", url.c_str( ));
+    return;
+  }
+  if( http_version.compare( 0, 5, "HTTP/" ) == 0 )
+  {
+    if( keep_alive )
+    {
+      response.AddHeader( "Connection", "keep-alive" );
+      response.AddHeader( "Keep-Alive", "timeout=%d", HTTP_KEEPALIVE_TIMEOUT );
+    }
+    else
+      response.AddHeader( "Connection", "close" );
+  }
   response.Finalize( );
-  server.SendToClient( client, response.GetBuffer( ).c_str( ), response.GetBuffer( ).size( ));
+  replied = server.SendToClient( client, response.GetBuffer( ).data( ), response.GetBuffer( ).size( ),
+                                 response.GetContent( ).data( ), response.GetContent( ).size( ));
+}
+
+bool HTTPRequest::ReplyFile( HTTPServer::Response &response, int fd, size_t size ) const
+{
+  if( replied )
+    return false;
+  response.AddContentLength( size );
+  Reply( response );
+  if( !server.SendFileToClient( client, fd, 0, size ))
+    replied = false;
+  return replied;
 }
 
 void HTTPRequest::Reply( HTTPStatus status ) const
@@ -967,14 +1316,26 @@ void HTTPRequest::Reply( HTTPStatus status, int ret ) const
 
 void HTTPRequest::Reply( json_object *obj ) const
 {
-  std::string json = json_object_to_json_string( obj );
+  ReplyJSON( json_object_to_json_string( obj ));
+  json_object_put( obj ); // free
+}
+
+void HTTPRequest::ReplyJSON( const std::string &json ) const
+{
   HTTPServer::Response response;
   response.AddStatus( HTTP_OK );
   response.AddTimeStamp( );
   response.AddMime( "json" );
-  response.AddContent( json );
+  std::string compressed;
+  if( json.size( ) >= HTTP_COMPRESS_MIN && AcceptsGzip( ) && HTTPServer::Compress( json, compressed ))
+  {
+    response.AddHeader( "Content-Encoding", "gzip" );
+    response.AddHeader( "Vary", "Accept-Encoding" );
+    response.AddContent( compressed );
+  }
+  else
+    response.AddContent( json );
   Reply( response );
-  json_object_put( obj ); // free
 }
 
 inline void nibble( char &x )
@@ -1043,7 +1404,7 @@ void HTTPServer::URLDecode( const std::string &string, std::string &decoded )
   }
 }
 
-HTTPRequest::HTTPRequest( HTTPServer &server, int client ) : server(server), client(client), content_length(-1), keep_alive(false)
+HTTPRequest::HTTPRequest( HTTPServer &server, int client ) : server(server), client(client), content_length(-1), keep_alive(false), replied(false)
 {
   memset( &client_addr, 0, sizeof( client_addr ));
   server.GetClientAddress( client, client_addr );
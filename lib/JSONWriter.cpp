@@ -0,0 +1,166 @@
+/*
+ *  tvdaemon
+ *
+ *  JSONWriter class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "JSONWriter.h"
+
+#include <stdio.h> // snprintf
+#include <string.h> // strlen
+
+JSONWriter::JSONWriter( std::string &out ) : out(out)
+{
+  first.push_back( true );
+  time_t now = time( NULL );
+  localtime_r( &now, &today );
+  tomorrow = today;
+  tomorrow.tm_mday++;
+  mktime( &tomorrow );
+}
+
+void JSONWriter::Key( const char *key )
+{
+  if( !first.back( ))
+    out += ',';
+  first.back( ) = false;
+  if( key )
+  {
+    String( key, strlen( key ));
+    out += ':';
+  }
+}
+
+void JSONWriter::String( const char *value, size_t length )
+{
+  static const char hex[] = "0123456789abcdef";
+  out += '"';
+  size_t start = 0;
+  for( size_t i = 0; i < length; i++ )
+  {
+    unsigned char c = value[i];
+    if( c >= 0x20 && c != '"' && c != '\\' )
+      continue;
+    out.append( value + start, i - start );
+    start = i + 1;
+    switch( c )
+    {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n";  break;
+      case '\r': out += "\\r";  break;
+      case '\t': out += "\\t";  break;
+      case '\b': out += "\\b";  break;
+      case '\f': out += "\\f";  break;
+      default:
+        out += "\\u00";
+        out += hex[c >> 4];
+        out += hex[c & 0x0f];
+    }
+  }
+  out.append( value + start, length - start );
+  out += '"';
+}
+
+void JSONWriter::BeginObject( const char *key )
+{
+  Key( key );
+  out += '{';
+  first.push_back( true );
+}
+
+void JSONWriter::EndObject( )
+{
+  out += '}';
+  first.pop_back( );
+}
+
+void JSONWriter::BeginArray( const char *key )
+{
+  Key( key );
+  out += '[';
+  first.push_back( true );
+}
+
+void JSONWriter::EndArray( )
+{
+  out += ']';
+  first.pop_back( );
+}
+
+void JSONWriter::Add( const char *key, int value )
+{
+  char t[16];
+  Key( key );
+  out.append( t, snprintf( t, sizeof( t ), "%d", value ));
+}
+
+void JSONWriter::Add( const char *key, long long value )
+{
+  char t[32];
+  Key( key );
+  out.append( t, snprintf( t, sizeof( t ), "%lld", value ));
+}
+
+void JSONWriter::Add( const char *key, double value )
+{
+  char t[32];
+  Key( key );
+  out.append( t, snprintf( t, sizeof( t ), "%.17g", value ));
+}
+
+void JSONWriter::Add( const char *key, const char *value )
+{
+  Key( key );
+  String( value, strlen( value ));
+}
+
+void JSONWriter::Add( const char *key, const std::string &value )
+{
+  Key( key );
+  String( value.c_str( ), value.length( ));
+}
+
+void JSONWriter::AddBool( const char *key, bool value )
+{
+  Key( key );
+  out += value ? "true" : "false";
+}
+
+void JSONWriter::AddTime( const char *key, time_t value )
+{
+  struct tm t;
+  localtime_r( &value, &t );
+  std::string name = key;
+  Add(( name + "_sec" ).c_str( ),        t.tm_sec );
+  Add(( name + "_min" ).c_str( ),        t.tm_min );
+  Add(( name + "_hour" ).c_str( ),       t.tm_hour );
+  Add(( name + "_day" ).c_str( ),        t.tm_mday );
+  Add(( name + "_month" ).c_str( ),      t.tm_mon + 1 );
+  Add(( name + "_year" ).c_str( ),       t.tm_year );
+  Add(( name + "_wday" ).c_str( ),       t.tm_wday );
+  Add(( name + "_istoday" ).c_str( ),    (int) ( t.tm_mday == today.tm_mday && t.tm_mon == today.tm_mon && t.tm_year == today.tm_year ));
+  Add(( name + "_istomorrow" ).c_str( ), (int) ( t.tm_mday == tomorrow.tm_mday && t.tm_mon == tomorrow.tm_mon && t.tm_year == tomorrow.tm_year ));
+}
+
+// for values still built with json-c
+void JSONWriter::AddRaw( const char *key, json_object *value )
+{
+  Key( key );
+  out += json_object_to_json_string( value );
+}
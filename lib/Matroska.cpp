@@ -40,12 +40,247 @@
 //#include "matroska/KaxChapters.h"
 //#include "matroska/KaxContentEncoding.h"
 
-Matroska::Matroska( const std::string& name ) :
-  name(name),
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdexcept>
+
+#define MATROSKA_IO_BUFFER_SIZE   MB(4)
+#define MATROSKA_POOL_MAX_FREE    64
+#define MATROSKA_POOL_MIN_CLASS   12  // 4 KB
+#define MATROSKA_POOL_MAX_CLASS   22  // 4 MB
+#define MATROSKA_CLUSTER_MIN_SIZE KB(256)
+#define MATROSKA_CLUSTER_MAX_SIZE MB(2)
+
+#define MATROSKA_TRACK_VIDEO      1
+#define MATROSKA_TRACK_AUDIO      2
+
+MatroskaIOCallback::MatroskaIOCallback( const std::string &filename, size_t buffer_size ) :
+  buffer_size(buffer_size),
+  buffer_fill(0),
+  position(0)
+{
+  fd = ::open( filename.c_str( ), O_CREAT | O_TRUNC | O_RDWR, 0664 );
+  if( fd < 0 )
+    throw std::runtime_error( "unable to create " + filename + ": " + strerror( errno ));
+  buffer = new binary[buffer_size];
+}
+
+MatroskaIOCallback::~MatroskaIOCallback( )
+{
+  close( );
+  delete[] buffer;
+}
+
+void MatroskaIOCallback::WriteAll( const binary *data, size_t size )
+{
+  size_t pos = 0;
+  while( pos < size )
+  {
+    ssize_t r = ::write( fd, data + pos, size - pos );
+    if( r < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      throw std::runtime_error( std::string( "write error: " ) + strerror( errno ));
+    }
+    pos += r;
+  }
+}
+
+void MatroskaIOCallback::Flush( )
+{
+  size_t fill = buffer_fill;
+  buffer_fill = 0;
+  WriteAll( buffer, fill );
+}
+
+uint32 MatroskaIOCallback::read( void *data, size_t size )
+{
+  Flush( );
+  ssize_t r = ::read( fd, data, size );
+  if( r < 0 )
+    return 0;
+  position += r;
+  return r;
+}
+
+void MatroskaIOCallback::setFilePointer( int64 offset, seek_mode mode )
+{
+  Flush( );
+  off_t r;
+  switch( mode )
+  {
+    case seek_current:
+      r = lseek( fd, position + offset, SEEK_SET );
+      break;
+    case seek_end:
+      r = lseek( fd, offset, SEEK_END );
+      break;
+    default:
+      r = lseek( fd, offset, SEEK_SET );
+      break;
+  }
+  if( r < 0 )
+    throw std::runtime_error( std::string( "seek error: " ) + strerror( errno ));
+  position = r;
+}
+
+size_t MatroskaIOCallback::write( const void *data, size_t size )
+{
+  if( buffer_fill + size > buffer_size )
+  {
+    Flush( );
+    if( size >= buffer_size ) // large payload: bypass the buffer
+    {
+      WriteAll( (const binary *) data, size );
+      position += size;
+      return size;
+    }
+  }
+  memcpy( buffer + buffer_fill, data, size );
+  buffer_fill += size;
+  position += size;
+  return size;
+}
+
+uint64 MatroskaIOCallback::getFilePointer( )
+{
+  return position;
+}
+
+void MatroskaIOCallback::close( )
+{
+  if( fd < 0 )
+    return;
+  try
+  {
+    Flush( );
+  }
+  catch( std::exception &e )
+  {
+    LogError( "Matroska: %s", e.what( ));
+  }
+  ::close( fd );
+  fd = -1;
+}
+
+MatroskaFramePool::MatroskaFramePool( size_t max_free ) :
+  max_free(max_free),
+  free_buffers(MATROSKA_POOL_MAX_CLASS - MATROSKA_POOL_MIN_CLASS + 1)
+{
+}
+
+MatroskaFramePool::~MatroskaFramePool( )
+{
+  for( std::vector<std::vector<binary *> >::iterator it = free_buffers.begin( ); it != free_buffers.end( ); it++ )
+    for( std::vector<binary *>::iterator it2 = it->begin( ); it2 != it->end( ); it2++ )
+      delete[] *it2;
+}
+
+int MatroskaFramePool::GetClass( size_t size )
+{
+  int c = MATROSKA_POOL_MIN_CLASS;
+  while( c <= MATROSKA_POOL_MAX_CLASS && ((size_t) 1 << c ) < size )
+    c++;
+  if( c > MATROSKA_POOL_MAX_CLASS )
+    return -1;
+  return c;
+}
+
+binary *MatroskaFramePool::Alloc( size_t size )
+{
+  int c = GetClass( size );
+  if( c < 0 )
+    return new binary[size];
+
+  ScopeLock _l( mutex );
+  std::vector<binary *> &list = free_buffers[c - MATROSKA_POOL_MIN_CLASS];
+  if( list.empty( ))
+    return new binary[(size_t) 1 << c];
+  binary *data = list.back( );
+  list.pop_back( );
+  return data;
+}
+
+void MatroskaFramePool::Free( binary *data, size_t size )
+{
+  int c = GetClass( size );
+  if( c >= 0 )
+  {
+    ScopeLock _l( mutex );
+    std::vector<binary *> &list = free_buffers[c - MATROSKA_POOL_MIN_CLASS];
+    if( list.size( ) < max_free )
+    {
+      list.push_back( data );
+      return;
+    }
+  }
+  delete[] data;
+}
+
+Mutex MatroskaFrame::free_mutex;
+std::vector<void *> MatroskaFrame::free_frames;
+
+MatroskaFrame::MatroskaFrame( MatroskaFramePool &pool, const uint8_t *data, size_t size ) :
+  DataBuffer( pool.Alloc( size ), size, Release ),
+  pool(pool)
+{
+  memcpy( myBuffer, data, size );
+}
+
+MatroskaFrame::~MatroskaFrame( )
+{
+  FreeBuffer( *this );
+}
+
+bool MatroskaFrame::Release( const DataBuffer &buffer )
+{
+  const MatroskaFrame &frame = static_cast<const MatroskaFrame &>( buffer );
+  frame.pool.Free( frame.myBuffer, frame.mySize );
+  return true;
+}
+
+void *MatroskaFrame::operator new( size_t size )
+{
+  {
+    ScopeLock _l( free_mutex );
+    if( size == sizeof( MatroskaFrame ) && !free_frames.empty( ))
+    {
+      void *p = free_frames.back( );
+      free_frames.pop_back( );
+      return p;
+    }
+  }
+  return ::operator new( size );
+}
+
+void MatroskaFrame::operator delete( void *p )
+{
+  if( !p )
+    return;
+  {
+    ScopeLock _l( free_mutex );
+    if( free_frames.size( ) < MATROSKA_POOL_MAX_FREE * 16 )
+    {
+      free_frames.push_back( p );
+      return;
+    }
+  }
+  ::operator delete( p );
+}
+
+Matroska::Matroska( const std::string &filename ) :
+  filename(filename),
   timecode_scale(1000000),   // default scale: 1 milisecond;
   out(NULL),
+  pool(MATROSKA_POOL_MAX_FREE),
   cluster(NULL),
-  track_count(0),
+  video_track(-1),
+  chunk(false),
+  tracks_written(false),
+  segment_size(0),
   curr_seg_size(0),
   cluster_size(0)
 {
@@ -55,9 +290,21 @@ Matroska::~Matroska( )
 {
   if( out )
   {
-    CloseCluster( );
-    WriteSegment( );
+    try
+    {
+      CloseCluster( );
+      if( !chunk )
+      {
+        WriteTracks( );
+        WriteSegment( );
+      }
+    }
+    catch( std::exception &e )
+    {
+      LogError( "Matroska: %s", e.what( ));
+    }
     out->close( );
+    delete out;
   }
 }
 
@@ -69,15 +316,11 @@ void Matroska::WriteSegment( )
     segment.OverwriteHead( *out );
 }
 
-void Matroska::WriteHeader( )
+bool Matroska::WriteHeader( const std::string &title )
 {
-  std::string dir; // FIXME
-  Utils::EnsureSlash( dir );
-  std::string filename = dir + name + ".mkv";
-
   try
   {
-    out = new StdIOCallback( filename.c_str( ), MODE_CREATE );
+    out = new MatroskaIOCallback( filename, MATROSKA_IO_BUFFER_SIZE );
 
     GetChildAs<EDocType,            EbmlString>  ( header ) = "matroska";
     GetChildAs<EDocTypeVersion,     EbmlUInteger>( header ) = MATROSKA_VERSION;
@@ -92,9 +335,11 @@ void Matroska::WriteHeader( )
     KaxInfo &info = GetChild<KaxInfo>( segment );
     UTFstring muxer;
     muxer.SetUTF8( std::string("libebml ") + EbmlCodeVersion + " & libmatroska " + KaxCodeVersion );
+    UTFstring utf_title;
+    utf_title.SetUTF8( title );
     *((EbmlUnicodeString *) &GetChildAs<KaxMuxingApp,    EbmlUnicodeString>( info )) = muxer;
     *((EbmlUnicodeString *) &GetChildAs<KaxWritingApp,   EbmlUnicodeString>( info )) = L"tvdaemon";
-    *((EbmlUnicodeString *) &GetChildAs<KaxTitle,        EbmlUnicodeString>( info )) = L"test mkv";
+    *((EbmlUnicodeString *) &GetChildAs<KaxTitle,        EbmlUnicodeString>( info )) = utf_title;
     GetChildAs<KaxTimecodeScale, EbmlUInteger>( info ) = timecode_scale;
 
     GetChildAs<KaxDuration, EbmlFloat>( info ) = 0.0;
@@ -115,45 +360,86 @@ void Matroska::WriteHeader( )
   catch( std::exception &e )
   {
     LogError( "Matroska: %s", e.what( ));
+    return false;
   }
+  return true;
 }
 
-void Matroska::AddTrack( )
+// a chunk contains clusters only, see AppendChunk
+bool Matroska::OpenChunk( )
 {
-  KaxTracks &tracks = GetChild<KaxTracks>( segment );
-  track = &GetChild<KaxTrackEntry>( tracks );
+  try
+  {
+    out = new MatroskaIOCallback( filename, MATROSKA_IO_BUFFER_SIZE );
+  }
+  catch( std::exception &e )
+  {
+    LogError( "Matroska: %s", e.what( ));
+    return false;
+  }
+  chunk = true;
+  return true;
+}
 
-  track->SetGlobalTimecodeScale( timecode_scale );
+KaxTrackEntry &Matroska::AddTrack( int type, const char *codec )
+{
+  KaxTracks &kaxtracks = GetChild<KaxTracks>( segment );
+  KaxTrackEntry &track = AddNewChild<KaxTrackEntry>( kaxtracks );
 
-  GetChildAs<KaxTrackNumber, EbmlUInteger>( *track ) = track_count + 1;
+  track.SetGlobalTimecodeScale( timecode_scale );
 
-  GetChildAs<KaxTrackUID, EbmlUInteger>( *track ) = track_count + 1;
-  //*(static_cast<EbmlUInteger *>(&trackUID)) = random();
+  GetChildAs<KaxTrackNumber, EbmlUInteger>( track ) = tracks.size( ) + 1;
+  GetChildAs<KaxTrackUID,    EbmlUInteger>( track ) = tracks.size( ) + 1;
+  GetChildAs<KaxTrackType,   EbmlUInteger>( track ) = type;
+  GetChildAs<KaxCodecID,     EbmlString>  ( track ) = codec;
+  //track.EnableLacing( false );
+
+  tracks.push_back( &track );
+  return track;
+}
 
-  //if (glob->outputTracks->at(i).theTrack)
-  //GetTrackInfoCopy(glob, trackInfo, *track, glob->outputTracks->at(i));
-  //else
-  //GetTrackInfoEncode(glob, *track, glob->outputTracks->at(i));
+int Matroska::AddVideoTrack( const char *codec, int width, int height, int display_width, int display_height, int display_unit )
+{
+  KaxTrackEntry &track = AddTrack( MATROSKA_TRACK_VIDEO, codec );
 
+  KaxTrackVideo &video = GetChild<KaxTrackVideo>( track );
+  GetChildAs<KaxVideoPixelWidth,    EbmlUInteger>( video ) = width;
+  GetChildAs<KaxVideoPixelHeight,   EbmlUInteger>( video ) = height;
+  GetChildAs<KaxVideoDisplayUnit,   EbmlUInteger>( video ) = display_unit;
+  GetChildAs<KaxVideoDisplayWidth,  EbmlUInteger>( video ) = display_width;
+  GetChildAs<KaxVideoDisplayHeight, EbmlUInteger>( video ) = display_height;
 
-  GetChildAs<KaxTrackType, EbmlUInteger>( *track ) = 1;
-  GetChildAs<KaxCodecID, EbmlString>( *track ) = "V_MPEG2";
-  //track.EnableLacing( false );
+  video_track = tracks.size( ) - 1;
+  return video_track;
+}
 
+int Matroska::AddAudioTrack( const char *codec, double sampling_frequency, int channels )
+{
+  KaxTrackEntry &track = AddTrack( MATROSKA_TRACK_AUDIO, codec );
 
+  KaxTrackAudio &audio = GetChild<KaxTrackAudio>( track );
+  GetChildAs<KaxAudioSamplingFreq, EbmlFloat>   ( audio ) = sampling_frequency;
+  GetChildAs<KaxAudioChannels,     EbmlUInteger>( audio ) = channels;
 
-  KaxTrackVideo &video = GetChild<KaxTrackVideo>( *track );
-  GetChildAs<KaxVideoPixelWidth, EbmlUInteger>( video ) = 720;
-  GetChildAs<KaxVideoPixelHeight, EbmlUInteger>( video ) = 576;
-  GetChildAs<KaxVideoDisplayUnit, EbmlUInteger>( video ) = 3;
-  GetChildAs<KaxVideoDisplayWidth, EbmlUInteger>( video ) = 1024;
-  GetChildAs<KaxVideoDisplayHeight, EbmlUInteger>( video ) = 576;
+  return tracks.size( ) - 1;
+}
 
-  //KaxCodecPrivate &codec = GetChild<KaxCodecPrivate>( track );
-  //codec.CopyBuffer((const binary *) extradata, extradata_size );
+void Matroska::SetCodecPrivate( int track, const uint8_t *data, size_t size )
+{
+  if( track < 0 || track >= (int) tracks.size( ))
+    return;
+  KaxCodecPrivate &codec = GetChild<KaxCodecPrivate>( *tracks[track] );
+  codec.CopyBuffer( (const binary *) data, size );
+}
 
-  curr_seg_size += tracks.Render( *out, false );
-  seek.IndexThis( tracks, segment );
+void Matroska::WriteTracks( )
+{
+  if( chunk || tracks_written || tracks.empty( ))
+    return;
+  KaxTracks &kaxtracks = GetChild<KaxTracks>( segment );
+  curr_seg_size += kaxtracks.Render( *out, false );
+  seek.IndexThis( kaxtracks, segment );
+  tracks_written = true;
 }
 
 void Matroska::CloseCluster( )
@@ -172,6 +458,7 @@ void Matroska::CloseCluster( )
 void Matroska::AddCluster( uint64_t ts )
 {
   CloseCluster( );
+  WriteTracks( );
   cluster = new KaxCluster( );
   cluster->SetParent( segment );
   cluster->InitTimecode( ts, timecode_scale );
@@ -179,42 +466,92 @@ void Matroska::AddCluster( uint64_t ts )
   cluster_size = 0;
 }
 
-void Matroska::AddFrame( uint64_t ts, dvb_mpeg_es_frame_t type, uint8_t *data, size_t size )
+bool Matroska::AddFrame( int track, uint64_t ts, dvb_mpeg_es_frame_t type, const uint8_t *data, size_t size )
 {
-  if( !track )
-    return;
+  if( !out || track < 0 || track >= (int) tracks.size( ))
+    return false;
   //Log( "Adding Frame @%ld: %d bytes", ts, size );
-  KaxBlockGroup *block;
-  DataBuffer *frame = new DataBuffer( (binary *) data, size, NULL, true ); // internal buffer
-
-  if( !cluster )
-    AddCluster( 0 );
 
-  //LogWarn( "delta: %ld * %ld - %ld", ts, timecode_scale, cluster->GlobalTimecode( ) );
-  int64_t delta = ((int64_t)( ts * timecode_scale ) - (int64_t) cluster->GlobalTimecode( )) / (int64_t) timecode_scale;
-  //LogWarn( "delta: %ld", (int64_t) delta );
-  // if keyframe: 2000000/4
-  if( delta > 32767ll || delta < -32768ll || cluster_size + size > 2000000 / 40 )
+  try
   {
-    AddCluster( ts );
-    delta = 0;
+    if( !cluster )
+      AddCluster( ts );
+
+    //LogWarn( "delta: %ld * %ld - %ld", ts, timecode_scale, cluster->GlobalTimecode( ) );
+    int64_t delta = ((int64_t)( ts * timecode_scale ) - (int64_t) cluster->GlobalTimecode( )) / (int64_t) timecode_scale;
+    //LogWarn( "delta: %ld", (int64_t) delta );
+    // start clusters on video keyframes where possible, but keep them bounded
+    if( delta > 32767ll || delta < -32768ll ||
+        cluster_size + size > MATROSKA_CLUSTER_MAX_SIZE ||
+        ( track == video_track && type == DVB_MPEG_ES_FRAME_I && cluster_size > MATROSKA_CLUSTER_MIN_SIZE ))
+    {
+      AddCluster( ts );
+      delta = 0;
+    }
+  }
+  catch( std::exception &e )
+  {
+    LogError( "Matroska: %s", e.what( ));
+    return false;
   }
   cluster_size += size;
 
+  DataBuffer *frame = new MatroskaFrame( pool, data, size );
   KaxSimpleBlock &simpleblock = AddNewChild<KaxSimpleBlock>( *cluster );
   //KaxSimpleBlock *simpleblock = new KaxSimpleBlock( );
   simpleblock.SetParent( *cluster );
-  simpleblock.AddFrame( *track, ts * timecode_scale, *frame, LACING_EBML );
+  simpleblock.AddFrame( *tracks[track], ts * timecode_scale, *frame, LACING_EBML );
   simpleblock.SetKeyframe( type == DVB_MPEG_ES_FRAME_I );
   simpleblock.SetDiscardable( type == DVB_MPEG_ES_FRAME_B );
 
   //KaxBlockBlob *blob = new KaxBlockBlob( BLOCK_BLOB_ALWAYS_SIMPLE );
   //blob->SetParent( *cluster );
-  //blob->AddFrameAuto( *track, ts * timecode_scale, *frame, LACING_EBML );
+  //blob->AddFrameAuto( *tracks[track], ts * timecode_scale, *frame, LACING_EBML );
   ////blob->SetBlockDuration( 50 * timecode_scale );
   //cluster->AddBlockBlob( blob );
 
   //cues.AddBlockBlob( simpleblock );
   //WriteSegment( );
+  return true;
 }
 
+// copy the clusters of a chunk written with OpenChunk into this segment
+bool Matroska::AppendChunk( const std::string &chunkfile )
+{
+  if( !out || chunk )
+    return false;
+
+  int fd = open( chunkfile.c_str( ), O_RDONLY );
+  if( fd < 0 )
+  {
+    LogError( "Matroska: cannot open chunk '%s'", chunkfile.c_str( ));
+    return false;
+  }
+
+  bool ret = true;
+  binary *buffer = new binary[MATROSKA_IO_BUFFER_SIZE];
+  try
+  {
+    CloseCluster( );
+    WriteTracks( );
+    ssize_t len;
+    while(( len = read( fd, buffer, MATROSKA_IO_BUFFER_SIZE )) > 0 )
+    {
+      out->write( buffer, len );
+      curr_seg_size += len;
+    }
+    if( len < 0 )
+    {
+      LogError( "Matroska: error reading chunk '%s'", chunkfile.c_str( ));
+      ret = false;
+    }
+  }
+  catch( std::exception &e )
+  {
+    LogError( "Matroska: %s", e.what( ));
+    ret = false;
+  }
+  delete[] buffer;
+  close( fd );
+  return ret;
+}
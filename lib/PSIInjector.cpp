@@ -0,0 +1,115 @@
+/*
+ *  tvdaemon
+ *
+ *  PSIInjector class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PSIInjector.h"
+
+#include "Log.h"
+
+#include <stdlib.h> // free
+#include <libdvbv5/mpeg_ts.h>
+#include <libdvbv5/sdt.h>
+#include <libdvbv5/pat.h>
+#include <libdvbv5/pmt.h>
+
+PSIInjector::PSIInjector( int interval ) : interval(interval), sent(false)
+{
+}
+
+PSIInjector::~PSIInjector( )
+{
+}
+
+bool PSIInjector::AddSection( struct dvb_v5_fe_parms *fe, uint8_t *section, ssize_t size, uint16_t pid )
+{
+  if( !section )
+  {
+    LogError( "PSIInjector: cannot store table for pid 0x%04x", pid );
+    return false;
+  }
+
+  uint8_t *mpegts = NULL;
+  size = dvb_mpeg_ts_create( fe, section, size, &mpegts, pid, 0 );
+  free( section );
+  if( !mpegts || size <= 0 )
+  {
+    LogError( "PSIInjector: cannot create TS packets for pid 0x%04x", pid );
+    free( mpegts );
+    return false;
+  }
+  packets.insert( packets.end( ), mpegts, mpegts + size );
+  free( mpegts );
+  if( size % DVB_MPEG_TS_PACKET_SIZE ) // stuff the last packet
+    packets.resize( packets.size( ) + DVB_MPEG_TS_PACKET_SIZE - size % DVB_MPEG_TS_PACKET_SIZE, 0xFF );
+  counters[pid] = 0;
+  return true;
+}
+
+bool PSIInjector::AddSDT( struct dvb_v5_fe_parms *fe, struct dvb_table_sdt *sdt )
+{
+  uint8_t *data = NULL;
+  ssize_t size = dvb_table_sdt_store( fe, sdt, &data );
+  return AddSection( fe, data, size, DVB_TABLE_SDT_PID );
+}
+
+bool PSIInjector::AddPAT( struct dvb_v5_fe_parms *fe, struct dvb_table_pat *pat )
+{
+  uint8_t *data = NULL;
+  ssize_t size = dvb_table_pat_store( fe, pat, &data );
+  return AddSection( fe, data, size, DVB_TABLE_PAT_PID );
+}
+
+bool PSIInjector::AddPMT( struct dvb_v5_fe_parms *fe, struct dvb_table_pmt *pmt, uint16_t pid )
+{
+  uint8_t *data = NULL;
+  ssize_t size = dvb_table_pmt_store( fe, pmt, &data );
+  return AddSection( fe, data, size, pid );
+}
+
+// true on the first call and whenever the interval has passed since the last true
+bool PSIInjector::Due( )
+{
+  struct timespec now;
+  clock_gettime( CLOCK_MONOTONIC, &now );
+  if( sent )
+  {
+    long elapsed = ( now.tv_sec - last.tv_sec ) * 1000 + ( now.tv_nsec - last.tv_nsec ) / 1000000;
+    if( elapsed < interval )
+      return false;
+  }
+  last = now;
+  sent = true;
+  return true;
+}
+
+// the tables as TS packets, continuity counters advanced for this insertion
+const uint8_t *PSIInjector::GetPackets( size_t &size )
+{
+  for( size_t i = 0; i + DVB_MPEG_TS_PACKET_SIZE <= packets.size( ); i += DVB_MPEG_TS_PACKET_SIZE )
+  {
+    uint8_t *p = &packets[i];
+    uint16_t pid = (( p[1] & 0x1F ) << 8 ) | p[2];
+    uint8_t &cc = counters[pid];
+    p[3] = ( p[3] & 0xF0 ) | cc;
+    cc = ( cc + 1 ) & 0x0F;
+  }
+  size = packets.size( );
+  return packets.empty( ) ? NULL : &packets[0];
+}
@@ -47,6 +47,16 @@ void json_object_time_add( json_object *j, std::string name, time_t tt )
                                                                                   t.tm_year == tnow.tm_year ));
 }
 
+// falls back to the json-c tree for objects without a writer implementation
+void JSONObject::serialize( JSONWriter &writer ) const
+{
+  json_object *j = json_object_new_object( );
+  json( j );
+  json_object_object_foreach( j, key, value )
+    writer.AddRaw( key, value );
+  json_object_put( j );
+}
+
 void json_object_object_add( json_object *j, int key, json_object *k )
 {
   char t[255];
@@ -25,6 +25,9 @@
 #include "Activity_Record.h"
 #include "Channel.h"
 #include "TVDaemon.h"
+#include "Remux.h"
+#include "Utils.h"
+#include "PSIInjector.h"
 
 #include <unistd.h> // sleep
 #include <algorithm> // sort
@@ -38,7 +41,10 @@ Recorder *Recorder::Instance( )
 Recorder::Recorder( ) :
   Thread( ),
   ConfigObject( ),
-  up(true)
+  up(true),
+  remux(NULL),
+  convert_threads(0),
+  psi_interval(PSI_INTERVAL)
 {
   std::string d = TVDaemon::Instance( )->GetConfigDir( );
   d += "recorder/";
@@ -51,6 +57,8 @@ Recorder::~Recorder( )
   up = false;
   JoinThread( );
   Lock( );
+  delete remux;
+  remux = NULL;
   for( std::map<int, Activity_Record *>::iterator it = recordings.begin( ); it != recordings.end( ); it++ )
     delete it->second;
   recordings.clear( );
@@ -60,6 +68,8 @@ Recorder::~Recorder( )
 bool Recorder::SaveConfig( )
 {
   WriteConfig( "Directory", dir );
+  WriteConfig( "ConvertThreads", convert_threads );
+  WriteConfig( "PSIInterval", psi_interval );
   WriteConfigFile( );
 
   Lock( );
@@ -78,6 +88,10 @@ bool Recorder::LoadConfig( )
     return false;
   }
   ReadConfig( "Directory", dir );
+  ReadConfig( "ConvertThreads", convert_threads );
+  ReadConfig( "PSIInterval", psi_interval );
+  if( psi_interval <= 0 )
+    psi_interval = PSI_INTERVAL;
   if( dir.empty( ))
     dir = "~";
   Log( "Recorder directoy: '%s'", dir.c_str( ));
@@ -159,15 +173,76 @@ void Recorder::Run( )
           break;
       }
     }
+    HandleConversions( );
     Unlock( );
     sleep( 1 );
   }
 }
 
+bool Recorder::Convert( int id )
+{
+  SCOPELOCK( );
+  std::map<int, Activity_Record *>::iterator it = recordings.find( id );
+  if( it == recordings.end( ))
+    return false;
+  if( !it->second->HasState( Activity::State_Done ) && !it->second->HasState( Activity::State_Aborted ))
+  {
+    LogError( "Recorder: recording %d is not finished", id );
+    return false;
+  }
+  for( std::list<int>::iterator it2 = conversions.begin( ); it2 != conversions.end( ); it2++ )
+    if( *it2 == id )
+      return true;
+  conversions.push_back( id );
+  Log( "Recorder: recording %d queued for conversion", id );
+  return true;
+}
+
+// called locked from Run, one conversion at a time as Remux uses all cores
+void Recorder::HandleConversions( )
+{
+  if( remux )
+  {
+    if( !remux->IsDone( ))
+      return;
+    if( remux->Succeeded( ))
+      Log( "Recorder: converted '%s'", remux->GetOutput( ).c_str( ));
+    delete remux;
+    remux = NULL;
+  }
+
+  while( !conversions.empty( ))
+  {
+    int id = conversions.front( );
+    conversions.pop_front( );
+    std::map<int, Activity_Record *>::iterator it = recordings.find( id );
+    if( it == recordings.end( ))
+      continue;
+
+    std::string input = it->second->GetFilename( );
+    if( !Utils::IsFile( input ))
+    {
+      LogError( "Recorder: recording file '%s' not found", input.c_str( ));
+      continue;
+    }
+    std::string output = input.substr( 0, input.find_last_of( "." )) + ".mkv";
+    remux = new Remux( input, output, it->second->GetName( ), convert_threads );
+    if( !remux->Start( ))
+    {
+      delete remux;
+      remux = NULL;
+      continue;
+    }
+    break;
+  }
+}
+
 void Recorder::Stop( )
 {
   SCOPELOCK( );
   up = false;
+  if( remux )
+    remux->Abort( );
   for( std::map<int, Activity_Record *>::iterator it = recordings.begin( ); it != recordings.end( ); it++ )
   {
     it->second->Abort( );
@@ -175,13 +250,10 @@ void Recorder::Stop( )
   }
 }
 
-void Recorder::GetRecordings( std::vector<const JSONObject *> &data ) const
+Recorder::Recordings::Recordings( const Recorder &recorder ) : lock(recorder)
 {
-  SCOPELOCK( );
-  for( std::map<int, Activity_Record *>::const_iterator it = recordings.begin( ); it != recordings.end( ); it++ )
-  {
-    data.push_back( it->second ); // FIXME: should not return pointers !!!
-  }
+  for( std::map<int, Activity_Record *>::const_iterator it = recorder.recordings.begin( ); it != recorder.recordings.end( ); it++ )
+    data.push_back( it->second );
 }
 
 bool Recorder::RPC( const HTTPRequest &request,  const std::string &cat, const std::string &action )
@@ -200,6 +272,46 @@ bool Recorder::RPC( const HTTPRequest &request,  const std::string &cat, const s
     return true;
   }
 
+  if( action == "set_stream_filter" )
+  {
+    int id;
+    if( !request.GetParam( "id", id ))
+      return false;
+    bool found = false;
+    {
+      // the recording may be removed by another request meanwhile
+      SCOPELOCK( );
+      std::map<int, Activity_Record *>::iterator it = recordings.find( id );
+      if( it != recordings.end( ))
+      {
+        it->second->GetStreamFilter( ).Set( request );
+        it->second->SaveConfig( );
+        found = true;
+      }
+    }
+    if( !found )
+    {
+      request.NotFound( "Recorder: unknown recording %d", id );
+      return false;
+    }
+    request.Reply( HTTP_OK );
+    return true;
+  }
+
+  if( action == "convert" )
+  {
+    int id;
+    if( !request.GetParam( "id", id ))
+      return false;
+    if( !Convert( id ))
+    {
+      request.NotFound( "Recorder: cannot convert recording %d", id );
+      return false;
+    }
+    request.Reply( HTTP_OK );
+    return true;
+  }
+
   request.NotFound( "RPC: unknown action: '%s'", action.c_str( ));
   return false;
 }
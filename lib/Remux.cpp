@@ -0,0 +1,957 @@
+/*
+ *  tvdaemon
+ *
+ *  Remux class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Remux.h"
+
+#include "Matroska.h"
+#include "Log.h"
+#include "Utils.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <libdvbv5/mpeg_ts.h>
+#include <libdvbv5/mpeg_es.h>
+
+#define REMUX_READ_SIZE      ( DVB_MPEG_TS_PACKET_SIZE * 4096 )
+#define REMUX_PROBE_SIZE     ( MB(32) )
+#define REMUX_MAX_OVERRUN    ( MB(32) )
+#define REMUX_MIN_CHUNK_SIZE ( MB(64) )
+
+#define PTS_MASK             0x1FFFFFFFFull
+
+static int ParseTSPacket( const uint8_t *p, uint16_t &pid, bool &start )
+{
+  if( p[0] != 0x47 || p[1] & 0x80 ) // sync byte, transport error
+    return -1;
+  if( p[3] & 0xC0 ) // scrambled
+    return -1;
+  pid = (( p[1] & 0x1F ) << 8 ) | p[2];
+  start = p[1] & 0x40;
+  int afc = ( p[3] >> 4 ) & 0x03;
+  if( !( afc & 0x01 )) // no payload
+    return -1;
+  int offset = 4;
+  if( afc & 0x02 )
+    offset += 1 + p[4];
+  if( offset >= DVB_MPEG_TS_PACKET_SIZE )
+    return -1;
+  return offset;
+}
+
+static bool ParsePES( const uint8_t *data, size_t size, uint64_t &pts, bool &got_pts, size_t &header )
+{
+  got_pts = false;
+  if( size < 9 || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01 )
+    return false;
+  header = 9 + data[8];
+  if( header > size )
+    return false;
+  if(( data[7] & 0x80 ) && header >= 14 )
+  {
+    pts = ((uint64_t) ( data[9] & 0x0E )) << 29 |
+          ((uint64_t) data[10]) << 22 |
+          ((uint64_t) ( data[11] & 0xFE )) << 14 |
+          ((uint64_t) data[12]) << 7 |
+          ((uint64_t) data[13]) >> 1;
+    got_pts = true;
+  }
+  return true;
+}
+
+class BitReader
+{
+  public:
+    BitReader( const uint8_t *data, size_t size ) : data(data), size(size), pos(0) { }
+
+    uint32_t Read( int bits )
+    {
+      uint32_t r = 0;
+      while( bits-- )
+      {
+        r <<= 1;
+        if( pos < size * 8 )
+          r |= ( data[pos / 8] >> ( 7 - pos % 8 )) & 0x01;
+        pos++;
+      }
+      return r;
+    }
+
+    uint32_t ReadUE( )
+    {
+      int zeros = 0;
+      while( pos < size * 8 && Read( 1 ) == 0 )
+        zeros++;
+      if( zeros > 31 )
+        return 0;
+      return ( 1u << zeros ) - 1 + Read( zeros );
+    }
+
+    int32_t ReadSE( )
+    {
+      uint32_t v = ReadUE( );
+      return v & 0x01 ? ( v + 1 ) / 2 : -(int32_t) ( v / 2 );
+    }
+
+  private:
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+};
+
+struct NAL
+{
+  const uint8_t *data;
+  size_t size;
+};
+
+static void SplitNALs( const uint8_t *es, size_t size, std::vector<NAL> &nals )
+{
+  nals.clear( );
+  size_t i = 0;
+  const uint8_t *start = NULL;
+  while( i + 3 <= size )
+  {
+    if( es[i] == 0x00 && es[i + 1] == 0x00 && es[i + 2] == 0x01 )
+    {
+      if( start )
+      {
+        size_t end = i;
+        while( end > (size_t) ( start - es ) && es[end - 1] == 0x00 )
+          end--;
+        NAL nal = { start, end - ( start - es ) };
+        nals.push_back( nal );
+      }
+      i += 3;
+      start = es + i;
+      continue;
+    }
+    i++;
+  }
+  if( start && start < es + size )
+  {
+    NAL nal = { start, size - ( start - es ) };
+    nals.push_back( nal );
+  }
+}
+
+static void RemoveEmulationPrevention( const uint8_t *data, size_t size, std::vector<uint8_t> &rbsp )
+{
+  rbsp.clear( );
+  rbsp.reserve( size );
+  for( size_t i = 0; i < size; i++ )
+  {
+    if( i + 2 < size && data[i] == 0x00 && data[i + 1] == 0x00 && data[i + 2] == 0x03 )
+    {
+      rbsp.push_back( 0x00 );
+      rbsp.push_back( 0x00 );
+      i += 2;
+      continue;
+    }
+    rbsp.push_back( data[i] );
+  }
+}
+
+static dvb_mpeg_es_frame_t GetFrameTypeMPEG2( const uint8_t *es, size_t size )
+{
+  for( size_t i = 0; i + 6 <= size; i++ )
+    if( es[i] == 0x00 && es[i + 1] == 0x00 && es[i + 2] == 0x01 && es[i + 3] == 0x00 ) // picture start
+      return (dvb_mpeg_es_frame_t) (( es[i + 5] >> 3 ) & 0x07 );
+  return DVB_MPEG_ES_FRAME_UNKNOWN;
+}
+
+static dvb_mpeg_es_frame_t GetFrameTypeH264( const std::vector<NAL> &nals )
+{
+  for( std::vector<NAL>::const_iterator it = nals.begin( ); it != nals.end( ); it++ )
+  {
+    if( it->size < 2 )
+      continue;
+    int type = it->data[0] & 0x1F;
+    if( type == 5 ) // IDR
+      return DVB_MPEG_ES_FRAME_I;
+    if( type != 1 )
+      continue;
+    // emulation prevention cannot occur this early in the slice header
+    BitReader b( it->data + 1, it->size - 1 );
+    b.ReadUE( ); // first_mb_in_slice
+    switch( b.ReadUE( ) % 5 )
+    {
+      case 2: // I
+      case 4: // SI
+        return DVB_MPEG_ES_FRAME_I;
+      case 0: // P
+      case 3: // SP
+        return DVB_MPEG_ES_FRAME_P;
+      case 1:
+        return DVB_MPEG_ES_FRAME_B;
+    }
+  }
+  return DVB_MPEG_ES_FRAME_UNKNOWN;
+}
+
+static bool ParseSPS( const NAL &nal, int &width, int &height )
+{
+  std::vector<uint8_t> rbsp;
+  RemoveEmulationPrevention( nal.data + 1, nal.size - 1, rbsp );
+  if( rbsp.size( ) < 4 )
+    return false;
+
+  BitReader b( &rbsp[0], rbsp.size( ));
+  int profile = b.Read( 8 );
+  b.Read( 16 ); // constraints, level
+  b.ReadUE( );  // seq_parameter_set_id
+
+  int chroma_format = 1;
+  switch( profile )
+  {
+    case 100: case 110: case 122: case 244: case 44:
+    case 83:  case 86:  case 118: case 128: case 138:
+    case 139: case 134:
+      chroma_format = b.ReadUE( );
+      if( chroma_format == 3 )
+        b.Read( 1 ); // separate_colour_plane_flag
+      b.ReadUE( );  // bit_depth_luma
+      b.ReadUE( );  // bit_depth_chroma
+      b.Read( 1 );  // qpprime_y_zero_transform_bypass_flag
+      if( b.Read( 1 )) // seq_scaling_matrix_present_flag
+        for( int i = 0; i < ( chroma_format != 3 ? 8 : 12 ); i++ )
+          if( b.Read( 1 ))
+          {
+            int count = i < 6 ? 16 : 64, last = 8, next = 8;
+            for( int j = 0; j < count; j++ )
+            {
+              if( next != 0 )
+                next = ( last + b.ReadSE( ) + 256 ) % 256;
+              if( next != 0 )
+                last = next;
+            }
+          }
+      break;
+  }
+
+  b.ReadUE( ); // log2_max_frame_num_minus4
+  int poc_type = b.ReadUE( );
+  if( poc_type == 0 )
+    b.ReadUE( );
+  else if( poc_type == 1 )
+  {
+    b.Read( 1 );
+    b.ReadSE( );
+    b.ReadSE( );
+    int n = b.ReadUE( );
+    for( int i = 0; i < n; i++ )
+      b.ReadSE( );
+  }
+  b.ReadUE( ); // max_num_ref_frames
+  b.Read( 1 ); // gaps_in_frame_num_value_allowed_flag
+
+  int w = b.ReadUE( ) + 1;
+  int h = b.ReadUE( ) + 1;
+  int frame_mbs_only = b.Read( 1 );
+  if( !frame_mbs_only )
+    b.Read( 1 ); // mb_adaptive_frame_field_flag
+  b.Read( 1 );   // direct_8x8_inference_flag
+
+  int crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+  if( b.Read( 1 ))
+  {
+    crop_left   = b.ReadUE( );
+    crop_right  = b.ReadUE( );
+    crop_top    = b.ReadUE( );
+    crop_bottom = b.ReadUE( );
+  }
+  int crop_x = ( chroma_format == 1 || chroma_format == 2 ) ? 2 : 1;
+  int crop_y = ( chroma_format == 1 ? 2 : 1 ) * ( 2 - frame_mbs_only );
+
+  width  = w * 16 - crop_x * ( crop_left + crop_right );
+  height = ( 2 - frame_mbs_only ) * h * 16 - crop_y * ( crop_top + crop_bottom );
+  return width > 0 && height > 0;
+}
+
+static void ToAVC( const std::vector<NAL> &nals, std::vector<uint8_t> &out )
+{
+  out.clear( );
+  for( std::vector<NAL>::const_iterator it = nals.begin( ); it != nals.end( ); it++ )
+  {
+    if( it->size == 0 || ( it->data[0] & 0x1F ) == 9 ) // skip access unit delimiters
+      continue;
+    out.push_back(( it->size >> 24 ) & 0xFF );
+    out.push_back(( it->size >> 16 ) & 0xFF );
+    out.push_back(( it->size >>  8 ) & 0xFF );
+    out.push_back(  it->size         & 0xFF );
+    out.insert( out.end( ), it->data, it->data + it->size );
+  }
+}
+
+static bool ProbeVideoMPEG2( const uint8_t *es, size_t size, int &width, int &height, int &display_width, int &display_height, int &display_unit )
+{
+  for( size_t i = 0; i + 8 <= size; i++ )
+  {
+    if( es[i] != 0x00 || es[i + 1] != 0x00 || es[i + 2] != 0x01 || es[i + 3] != 0xB3 ) // sequence header
+      continue;
+    width  = ( es[i + 4] << 4 ) | ( es[i + 5] >> 4 );
+    height = (( es[i + 5] & 0x0F ) << 8 ) | es[i + 6];
+    switch( es[i + 7] >> 4 )
+    {
+      case 2:
+        display_width = 4;
+        display_height = 3;
+        display_unit = 3; // aspect ratio
+        break;
+      case 3:
+        display_width = 16;
+        display_height = 9;
+        display_unit = 3;
+        break;
+      default:
+        display_width = width;
+        display_height = height;
+        display_unit = 0;
+        break;
+    }
+    return width > 0 && height > 0;
+  }
+  return false;
+}
+
+static bool ProbeAudioMPEG( const uint8_t *es, size_t size, const char *&codec, int &sampling_frequency, int &channels )
+{
+  static const int rates[] = { 44100, 48000, 32000 };
+  for( size_t i = 0; i + 4 <= size; i++ )
+  {
+    if( es[i] != 0xFF || ( es[i + 1] & 0xE0 ) != 0xE0 )
+      continue;
+    int version = ( es[i + 1] >> 3 ) & 0x03;
+    int layer   = ( es[i + 1] >> 1 ) & 0x03;
+    int rate    = ( es[i + 2] >> 2 ) & 0x03;
+    if( version == 1 || layer == 0 || rate == 3 )
+      continue;
+    switch( layer )
+    {
+      case 3: codec = "A_MPEG/L1"; break;
+      case 2: codec = "A_MPEG/L2"; break;
+      case 1: codec = "A_MPEG/L3"; break;
+    }
+    sampling_frequency = rates[rate];
+    if( version == 2 )      // MPEG 2
+      sampling_frequency /= 2;
+    else if( version == 0 ) // MPEG 2.5
+      sampling_frequency /= 4;
+    channels = ( es[i + 3] >> 6 ) == 3 ? 1 : 2;
+    return true;
+  }
+  return false;
+}
+
+static bool ProbeAudioAC3( const uint8_t *es, size_t size, int &sampling_frequency, int &channels )
+{
+  static const int rates[] = { 48000, 44100, 32000 };
+  static const int acmod_channels[] = { 2, 1, 2, 3, 3, 4, 4, 5 };
+  for( size_t i = 0; i + 7 <= size; i++ )
+  {
+    if( es[i] != 0x0B || es[i + 1] != 0x77 )
+      continue;
+    int fscod = es[i + 4] >> 6;
+    if( fscod == 3 )
+      continue;
+    sampling_frequency = rates[fscod];
+    channels = acmod_channels[es[i + 6] >> 5];
+    return true;
+  }
+  return false;
+}
+
+Remux::Remux( const std::string &input, const std::string &output, const std::string &title, int workers ) :
+  Thread( ),
+  input(input),
+  output(output),
+  title(title),
+  workers(workers),
+  fd(-1),
+  size(0),
+  base_pts(0),
+  up(true),
+  done(false),
+  success(false)
+{
+}
+
+Remux::~Remux( )
+{
+  up = false;
+  JoinThread( );
+  if( fd >= 0 )
+    close( fd );
+}
+
+bool Remux::Start( )
+{
+  return StartThread( );
+}
+
+void Remux::Run( )
+{
+  success = Convert( );
+  done = true;
+}
+
+bool Remux::Convert( )
+{
+  bool ret = false;
+  int n;
+  std::vector<off_t> bounds;
+  std::vector<Worker *> chunks;
+  Matroska *mkv = NULL;
+  Prober prober( *this );
+
+  fd = open( input.c_str( ), O_RDONLY );
+  if( fd < 0 )
+  {
+    LogError( "Remux: cannot open '%s': %s", input.c_str( ), strerror( errno ));
+    return false;
+  }
+  size = lseek( fd, 0, SEEK_END );
+  size -= size % DVB_MPEG_TS_PACKET_SIZE;
+
+  if( !ReadPMT( ))
+    goto exit;
+
+  // find codec parameters and the first keyframe
+  if( !prober.Process( 0, REMUX_PROBE_SIZE ))
+    goto exit;
+  for( std::vector<Track>::iterator it = tracks.begin( ); it != tracks.end( ); )
+  {
+    if( !it->probed )
+    {
+      LogWarn( "Remux: no codec parameters found for pid %d, skipping", it->pid );
+      it = tracks.erase( it );
+    }
+    else
+      it++;
+  }
+  track_index.clear( );
+  for( size_t i = 0; i < tracks.size( ); i++ )
+    track_index[tracks[i].pid] = i;
+  if( tracks.empty( ) || prober.keyframe < 0 )
+  {
+    LogError( "Remux: no usable streams found in '%s'", input.c_str( ));
+    goto exit;
+  }
+  base_pts = prober.keyframe_pts;
+
+  n = workers > 0 ? workers : sysconf( _SC_NPROCESSORS_ONLN );
+  if( n > size / (off_t) REMUX_MIN_CHUNK_SIZE )
+    n = size / REMUX_MIN_CHUNK_SIZE;
+  if( n < 1 || !tracks[0].video )
+    n = 1;
+
+  // split on keyframes, so each chunk can be decoded on its own
+  bounds.push_back( prober.keyframe );
+  for( int i = 1; i < n && up; i++ )
+  {
+    off_t split = size / n * i;
+    split -= split % DVB_MPEG_TS_PACKET_SIZE;
+    if( split <= bounds.back( ))
+      continue;
+    off_t keyframe = FindKeyframe( split );
+    if( keyframe < 0 )
+      break;
+    if( keyframe > bounds.back( ))
+      bounds.push_back( keyframe );
+  }
+  bounds.push_back( size );
+
+  Log( "Remux: converting '%s' in %d chunks", input.c_str( ), (int) bounds.size( ) - 1 );
+
+  for( size_t i = 0; i + 1 < bounds.size( ); i++ )
+  {
+    Worker *w = new Worker( *this, i, bounds[i], bounds[i + 1] );
+    chunks.push_back( w );
+    if( !w->Start( ))
+      up = false;
+  }
+  for( std::vector<Worker *>::iterator it = chunks.begin( ); it != chunks.end( ); it++ )
+    (*it)->Join( );
+  if( !up )
+    goto exit;
+  for( std::vector<Worker *>::iterator it = chunks.begin( ); it != chunks.end( ); it++ )
+    if( !(*it)->Succeeded( ))
+      goto exit;
+
+  mkv = new Matroska( output );
+  if( !mkv->WriteHeader( title ))
+    goto exit;
+  AddTracks( *mkv, true );
+  for( std::vector<Worker *>::iterator it = chunks.begin( ); it != chunks.end( ); it++ )
+    if( !mkv->AppendChunk( (*it)->GetFilename( )))
+      goto exit;
+  ret = true;
+
+exit:
+  delete mkv;
+  for( std::vector<Worker *>::iterator it = chunks.begin( ); it != chunks.end( ); it++ )
+  {
+    unlink( (*it)->GetFilename( ).c_str( ));
+    delete *it;
+  }
+  close( fd );
+  fd = -1;
+  if( ret )
+    Log( "Remux: '%s' written", output.c_str( ));
+  else
+  {
+    LogError( "Remux: converting '%s' failed", input.c_str( ));
+    unlink( output.c_str( ));
+  }
+  return ret;
+}
+
+// only single packet PAT and PMT sections are supported, which is what Activity_Record writes
+bool Remux::ReadPMT( )
+{
+  uint8_t p[DVB_MPEG_TS_PACKET_SIZE];
+  int pmt_pid = -1;
+
+  for( off_t pos = 0; pos < (off_t) REMUX_PROBE_SIZE; pos += DVB_MPEG_TS_PACKET_SIZE )
+  {
+    if( pread( fd, p, DVB_MPEG_TS_PACKET_SIZE, pos ) != DVB_MPEG_TS_PACKET_SIZE )
+      break;
+
+    uint16_t pid;
+    bool start;
+    int payload = ParseTSPacket( p, pid, start );
+    if( payload < 0 || !start )
+      continue;
+    if( pid != 0 && pid != pmt_pid )
+      continue;
+
+    payload += 1 + p[payload]; // pointer field
+    if( payload + 12 > DVB_MPEG_TS_PACKET_SIZE )
+      continue;
+    const uint8_t *s = p + payload;
+    int section_length = (( s[1] & 0x0F ) << 8 ) | s[2];
+    const uint8_t *s_end = s + 3 + section_length - 4; // without CRC
+    if( s_end > p + DVB_MPEG_TS_PACKET_SIZE )
+      continue;
+
+    if( pid == 0 && s[0] == 0x00 )
+    {
+      for( const uint8_t *q = s + 8; q + 4 <= s_end; q += 4 )
+      {
+        uint16_t program = ( q[0] << 8 ) | q[1];
+        if( program != 0 )
+        {
+          pmt_pid = (( q[2] & 0x1F ) << 8 ) | q[3];
+          break;
+        }
+      }
+      continue;
+    }
+
+    if( s[0] != 0x02 )
+      continue;
+
+    int program_info_length = (( s[10] & 0x0F ) << 8 ) | s[11];
+    const uint8_t *q = s + 12 + program_info_length;
+    bool has_video = false;
+    while( q + 5 <= s_end )
+    {
+      int type = q[0];
+      uint16_t es_pid = (( q[1] & 0x1F ) << 8 ) | q[2];
+      int es_info_length = (( q[3] & 0x0F ) << 8 ) | q[4];
+      if( type == 0x06 ) // private data, look for AC3 descriptors
+        for( const uint8_t *d = q + 5; d + 2 <= q + 5 + es_info_length; d += 2 + d[1] )
+        {
+          if( d[0] == 0x6A )
+            type = 0x81;
+          else if( d[0] == 0x7A )
+            type = 0x87;
+        }
+      q += 5 + es_info_length;
+
+      Track t;
+      t.pid = es_pid;
+      t.stream_type = type;
+      t.video = false;
+      t.h264 = false;
+      t.probed = false;
+      t.codec = NULL;
+      t.width = t.height = 0;
+      t.display_width = t.display_height = t.display_unit = 0;
+      t.sampling_frequency = 0;
+      t.channels = 0;
+      switch( type )
+      {
+        case 0x01:
+        case 0x02:
+          t.video = true;
+          t.codec = "V_MPEG2";
+          break;
+        case 0x1B:
+          t.video = true;
+          t.h264 = true;
+          t.codec = "V_MPEG4/ISO/AVC";
+          break;
+        case 0x03:
+        case 0x04:
+          break; // codec depends on the layer
+        case 0x81:
+          t.codec = "A_AC3";
+          break;
+        case 0x87:
+          t.codec = "A_EAC3";
+          break;
+        default:
+          LogWarn( "Remux: unsupported stream type 0x%02x on pid %d, skipping", type, es_pid );
+          continue;
+      }
+      if( t.video )
+      {
+        if( has_video )
+        {
+          LogWarn( "Remux: ignoring additional video stream on pid %d", es_pid );
+          continue;
+        }
+        has_video = true;
+        tracks.insert( tracks.begin( ), t ); // video first
+      }
+      else
+        tracks.push_back( t );
+    }
+
+    for( size_t i = 0; i < tracks.size( ); i++ )
+      track_index[tracks[i].pid] = i;
+    return !tracks.empty( );
+  }
+
+  LogError( "Remux: no PMT found in '%s'", input.c_str( ));
+  return false;
+}
+
+off_t Remux::FindKeyframe( off_t from )
+{
+  Prober prober( *this );
+  prober.probe_all = false;
+  if( !prober.Process( from, size ))
+    return -1;
+  return prober.keyframe;
+}
+
+void Remux::AddTracks( Matroska &mkv, bool codec_private )
+{
+  for( std::vector<Track>::iterator it = tracks.begin( ); it != tracks.end( ); it++ )
+  {
+    int t;
+    if( it->video )
+      t = mkv.AddVideoTrack( it->codec, it->width, it->height, it->display_width, it->display_height, it->display_unit );
+    else
+      t = mkv.AddAudioTrack( it->codec, it->sampling_frequency, it->channels );
+    if( codec_private && !it->codec_private.empty( ))
+      mkv.SetCodecPrivate( t, &it->codec_private[0], it->codec_private.size( ));
+  }
+}
+
+bool Remux::GetTimecode( uint64_t pts, uint64_t &ts ) const
+{
+  uint64_t delta = ( pts - base_pts ) & PTS_MASK;
+  if( delta > ( PTS_MASK >> 1 )) // before the first keyframe
+    return false;
+  ts = delta / 90; // 90 kHz to ms
+  return true;
+}
+
+Remux::Demux::Demux( Remux &remux ) : remux(remux)
+{
+}
+
+Remux::Demux::~Demux( )
+{
+}
+
+// Assembles the PES packets of all tracks starting in [begin, end). PES
+// packets started before end are completed even if they reach beyond.
+bool Remux::Demux::Process( off_t begin, off_t end )
+{
+  std::vector<uint8_t> buffer( REMUX_READ_SIZE );
+  int active = 0;
+  off_t pos = begin;
+  bool stop = false;
+
+  pending.clear( );
+
+  while( !stop && remux.up )
+  {
+    ssize_t len = pread( remux.fd, &buffer[0], REMUX_READ_SIZE, pos );
+    if( len < 0 )
+    {
+      if( errno == EINTR )
+        continue;
+      LogError( "Remux: error reading '%s': %s", remux.input.c_str( ), strerror( errno ));
+      return false;
+    }
+    if( len < DVB_MPEG_TS_PACKET_SIZE )
+      break;
+
+    ssize_t i;
+    for( i = 0; i + DVB_MPEG_TS_PACKET_SIZE <= len; i += DVB_MPEG_TS_PACKET_SIZE )
+    {
+      off_t offset = pos + i;
+      if( offset >= end && ( active == 0 || offset >= end + (off_t) REMUX_MAX_OVERRUN ))
+      {
+        stop = true;
+        break;
+      }
+
+      const uint8_t *p = &buffer[i];
+      uint16_t pid;
+      bool start;
+      int payload = ParseTSPacket( p, pid, start );
+      if( payload < 0 )
+        continue;
+      std::map<uint16_t, int>::iterator t = remux.track_index.find( pid );
+      if( t == remux.track_index.end( ))
+        continue;
+
+      Pending &pes = pending[pid];
+      if( start )
+      {
+        if( pes.offset >= 0 )
+        {
+          active--;
+          off_t pes_offset = pes.offset;
+          pes.offset = -1;
+          if( !HandlePES( remux.tracks[t->second], pes_offset, &pes.data[0], pes.data.size( )))
+          {
+            stop = true;
+            break;
+          }
+        }
+        if( offset < end )
+        {
+          pes.offset = offset;
+          pes.data.assign( p + payload, p + DVB_MPEG_TS_PACKET_SIZE );
+          active++;
+        }
+      }
+      else if( pes.offset >= 0 )
+        pes.data.insert( pes.data.end( ), p + payload, p + DVB_MPEG_TS_PACKET_SIZE );
+    }
+    pos += i;
+  }
+
+  if( stop || !remux.up )
+    return true;
+
+  // end of file: flush what is left
+  for( std::map<uint16_t, Pending>::iterator it = pending.begin( ); it != pending.end( ); it++ )
+  {
+    if( it->second.offset < 0 )
+      continue;
+    if( !HandlePES( remux.tracks[remux.track_index[it->first]], it->second.offset, &it->second.data[0], it->second.data.size( )))
+      break;
+  }
+  return true;
+}
+
+bool Remux::Prober::HandlePES( Track &track, off_t offset, const uint8_t *data, size_t size )
+{
+  uint64_t pts;
+  bool got_pts;
+  size_t header;
+  if( !ParsePES( data, size, pts, got_pts, header ))
+    return true;
+  const uint8_t *es = data + header;
+  size_t es_size = size - header;
+
+  if( !track.video )
+  {
+    if( probe_all && !track.probed )
+    {
+      if( track.stream_type == 0x03 || track.stream_type == 0x04 )
+        track.probed = ProbeAudioMPEG( es, es_size, track.codec, track.sampling_frequency, track.channels );
+      else
+        track.probed = ProbeAudioAC3( es, es_size, track.sampling_frequency, track.channels );
+    }
+    if( keyframe < 0 && got_pts && !remux.tracks[0].video ) // audio only
+    {
+      keyframe = offset;
+      keyframe_pts = pts;
+    }
+  }
+  else if( keyframe < 0 && got_pts )
+  {
+    std::vector<NAL> nals;
+    dvb_mpeg_es_frame_t type;
+    if( track.h264 )
+    {
+      SplitNALs( es, es_size, nals );
+      type = GetFrameTypeH264( nals );
+    }
+    else
+      type = GetFrameTypeMPEG2( es, es_size );
+
+    if( type == DVB_MPEG_ES_FRAME_I )
+    {
+      if( probe_all && !track.probed )
+      {
+        if( track.h264 )
+        {
+          const NAL *sps = NULL, *pps = NULL;
+          for( std::vector<NAL>::const_iterator it = nals.begin( ); it != nals.end( ); it++ )
+          {
+            if( it->size < 4 )
+              continue;
+            if(( it->data[0] & 0x1F ) == 7 && !sps )
+              sps = &*it;
+            else if(( it->data[0] & 0x1F ) == 8 && !pps )
+              pps = &*it;
+          }
+          if( sps && pps && ParseSPS( *sps, track.width, track.height ))
+          {
+            track.display_width  = track.width;
+            track.display_height = track.height;
+            track.display_unit   = 0;
+
+            // AVCDecoderConfigurationRecord
+            std::vector<uint8_t> &c = track.codec_private;
+            c.clear( );
+            c.push_back( 1 );
+            c.insert( c.end( ), sps->data + 1, sps->data + 4 ); // profile, compat, level
+            c.push_back( 0xFF ); // 4 byte NAL lengths
+            c.push_back( 0xE1 ); // 1 SPS
+            c.push_back(( sps->size >> 8 ) & 0xFF );
+            c.push_back(  sps->size        & 0xFF );
+            c.insert( c.end( ), sps->data, sps->data + sps->size );
+            c.push_back( 1 );    // 1 PPS
+            c.push_back(( pps->size >> 8 ) & 0xFF );
+            c.push_back(  pps->size        & 0xFF );
+            c.insert( c.end( ), pps->data, pps->data + pps->size );
+            track.probed = true;
+          }
+        }
+        else
+          track.probed = ProbeVideoMPEG2( es, es_size, track.width, track.height, track.display_width, track.display_height, track.display_unit );
+      }
+      if( track.probed || !probe_all )
+      {
+        keyframe = offset;
+        keyframe_pts = pts;
+      }
+    }
+  }
+
+  if( !probe_all )
+    return keyframe < 0;
+  if( keyframe < 0 )
+    return true;
+  for( std::vector<Track>::iterator it = remux.tracks.begin( ); it != remux.tracks.end( ); it++ )
+    if( !it->probed )
+      return true;
+  return false;
+}
+
+Remux::Worker::Worker( Remux &remux, int id, off_t begin, off_t end ) :
+  Thread( ),
+  Demux( remux ),
+  begin(begin),
+  end(end),
+  mkv(NULL),
+  success(false)
+{
+  char tmp[16];
+  snprintf( tmp, sizeof( tmp ), ".part%d", id );
+  filename = remux.output + tmp;
+}
+
+Remux::Worker::~Worker( )
+{
+  JoinThread( );
+  delete mkv;
+}
+
+void Remux::Worker::Run( )
+{
+  mkv = new Matroska( filename );
+  if( !mkv->OpenChunk( ))
+    return;
+  remux.AddTracks( *mkv, false );
+  success = true;
+  if( !Process( begin, end ))
+    success = false;
+  delete mkv; // flushes the chunk
+  mkv = NULL;
+}
+
+bool Remux::Worker::HandlePES( Track &track, off_t offset, const uint8_t *data, size_t size )
+{
+  uint64_t pts, ts;
+  bool got_pts;
+  size_t header;
+  if( !ParsePES( data, size, pts, got_pts, header ))
+    return true;
+  const uint8_t *es = data + header;
+  size_t es_size = size - header;
+  if( es_size == 0 )
+    return true;
+
+  if( got_pts )
+  {
+    if( !remux.GetTimecode( pts, ts ))
+      return true;
+    last_ts[track.pid] = ts;
+  }
+  else
+  {
+    std::map<uint16_t, uint64_t>::iterator it = last_ts.find( track.pid );
+    if( it == last_ts.end( ))
+      return true;
+    ts = it->second;
+  }
+
+  dvb_mpeg_es_frame_t type = DVB_MPEG_ES_FRAME_I; // audio frames are always keyframes
+  if( track.video )
+  {
+    if( track.h264 )
+    {
+      std::vector<NAL> nals;
+      SplitNALs( es, es_size, nals );
+      type = GetFrameTypeH264( nals );
+      ToAVC( nals, buffer );
+      if( buffer.empty( ))
+        return true;
+      es = &buffer[0];
+      es_size = buffer.size( );
+    }
+    else
+      type = GetFrameTypeMPEG2( es, es_size );
+  }
+
+  int index = &track - &remux.tracks[0];
+  if( !mkv->AddFrame( index, ts, type, es, es_size ))
+  {
+    success = false;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,149 @@
+/*
+ *  tvdaemon
+ *
+ *  SectionFilterPool class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SectionFilterPool.h"
+
+#include "Frontend.h"
+
+#include <errno.h>
+#include <string.h> // strerror
+#include <unistd.h>
+#include <libdvbv5/dvb-demux.h>
+
+SectionFilterPool::SectionFilterPool( Frontend &frontend, int max ) :
+  frontend(frontend),
+  max(max),
+  ready(0),
+  next(0)
+{
+  if( this->max > SECTION_FILTER_POOL_MAX )
+    this->max = SECTION_FILTER_POOL_MAX;
+  epoll_fd = epoll_create( SECTION_FILTER_POOL_MAX );
+  if( epoll_fd < 0 )
+    frontend.LogError( "SectionFilterPool: epoll_create failed: %s", strerror( errno ));
+}
+
+SectionFilterPool::~SectionFilterPool( )
+{
+  Clear( );
+  if( epoll_fd >= 0 )
+    close( epoll_fd );
+}
+
+int SectionFilterPool::Add( uint16_t pid, int table_id )
+{
+  if( epoll_fd < 0 or IsFull( ))
+    return -1;
+
+  int fd = frontend.OpenDemux( );
+  if( fd < 0 )
+  {
+    frontend.LogError( "SectionFilterPool: unable to open demux" );
+    return -1;
+  }
+
+  unsigned char filter = table_id, mask = 0xff;
+  struct epoll_event ev;
+  if( dvb_set_section_filter( fd, pid, table_id < 0 ? 0 : 1, &filter, &mask, NULL, DMX_IMMEDIATE_START | DMX_CHECK_CRC ) < 0 )
+  {
+    frontend.LogError( "SectionFilterPool: unable to set filter on pid %d", pid );
+    goto fail;
+  }
+
+  memset( &ev, 0, sizeof( ev ));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+  {
+    frontend.LogError( "SectionFilterPool: epoll_ctl failed: %s", strerror( errno ));
+    goto fail;
+  }
+
+  filters[fd] = pid;
+  return fd;
+
+fail:
+  frontend.CloseDemux( fd );
+  return -1;
+}
+
+void SectionFilterPool::Remove( int filter )
+{
+  std::map<int, uint16_t>::iterator it = filters.find( filter );
+  if( it == filters.end( ))
+    return;
+  epoll_ctl( epoll_fd, EPOLL_CTL_DEL, filter, NULL );
+  frontend.CloseDemux( filter );
+  filters.erase( it );
+  // a pending event of this fd is skipped in Read
+}
+
+void SectionFilterPool::Clear( )
+{
+  while( !filters.empty( ))
+    Remove( filters.begin( )->first );
+  ready = next = 0;
+}
+
+uint16_t SectionFilterPool::GetPID( int filter ) const
+{
+  std::map<int, uint16_t>::const_iterator it = filters.find( filter );
+  if( it == filters.end( ))
+    return 0xffff;
+  return it->second;
+}
+
+ssize_t SectionFilterPool::Read( int &filter, uint8_t *data, size_t size, int timeout )
+{
+  if( epoll_fd < 0 or filters.empty( ))
+    return -1;
+
+  while( true )
+  {
+    while( next < ready )
+    {
+      int fd = events[next++].data.fd;
+      if( filters.find( fd ) == filters.end( ))
+        continue; // removed meanwhile
+      ssize_t len = read( fd, data, size );
+      if( len > 0 )
+      {
+        filter = fd;
+        return len;
+      }
+      if( len < 0 and errno != EOVERFLOW and errno != EAGAIN and errno != EINTR )
+        frontend.LogError( "SectionFilterPool: read error on pid %d: %s", filters[fd], strerror( errno ));
+    }
+
+    next = 0;
+    ready = epoll_wait( epoll_fd, events, SECTION_FILTER_POOL_MAX, timeout );
+    if( ready < 0 )
+    {
+      ready = 0;
+      if( errno == EINTR )
+        return 0;
+      frontend.LogError( "SectionFilterPool: epoll_wait failed: %s", strerror( errno ));
+      return -1;
+    }
+    if( ready == 0 )
+      return 0;
+  }
+}
@@ -145,20 +145,20 @@ bool Service::LoadConfig( ConfigBase &config )
   return true;
 }
 
-bool Service::UpdateStream( int id, Stream::Type type )
+bool Service::UpdateStream( int id, Stream::Type type, const std::string &language )
 {
   std::map<uint16_t, Stream *>::iterator it = streams.find( id );
   Stream *s;
   if( it == streams.end( ))
   {
-    s = new Stream( *this, id, type, streams.size( ));
+    s = new Stream( *this, id, type, language, streams.size( ));
     streams[id] = s;
     return true;
   }
 
   //LogWarn( "Already known Stream %d", id );
   s = it->second;
-  return s->Update( type );
+  return s->Update( type, language );
 }
 
 std::map<uint16_t, Stream *> &Service::GetStreams() // FIXME: const
@@ -193,6 +193,19 @@ void Service::json( json_object *entry ) const
   json_object_object_add( entry, "transponder",    json_object_new_string( transponder.toString( ).c_str( )));
 }
 
+void Service::serialize( JSONWriter &writer ) const
+{
+  writer.Add( "name",           name );
+  writer.Add( "provider",       provider );
+  writer.Add( "id",             GetKey( ));
+  writer.Add( "type",           type );
+  writer.Add( "scrambled",      IsScrambled( ) ? 1 : 0 );
+  writer.Add( "channel",        channel ? 1 : 0 );
+  writer.Add( "transponder_id", transponder.GetKey( ));
+  writer.Add( "source_id",      transponder.GetSource( ).GetKey( ));
+  writer.Add( "transponder",    transponder.toString( ));
+}
+
 bool Service::RPC( const HTTPRequest &request, const std::string &cat, const std::string &action )
 {
   if( cat == "service" )
@@ -266,6 +279,9 @@ bool Service::RPC( const HTTPRequest &request, const std::string &cat, const std
       }
       request.Reply( HTTP_OK );
       transponder.HasChannels( true );
+      // EIT sections of services without channel were dropped but cached
+      // as seen, read them again
+      transponder.UpdateEPG( );
       transponder.SaveConfig( );
       return true;
     }
@@ -286,24 +302,26 @@ bool Service::Tune( Activity &act )
   return transponder.Tune( act );
 }
 
-bool Service::ReadEPG( const struct dvb_table_eit_event *event )
+int Service::AddEPG( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version )
 {
   if( !channel )
-    return false;
-  channel->ClearEPG( );
+    return 0;
   int i = 0;
   while( event )
   {
-    if( event->service_id == GetKey( ))
-    {
-      channel->AddEPGEvent( event );
+    if( event->service_id == GetKey( ) and channel->AddEPGEvent( event, table_id, version ))
       i++;
-    }
     event = event->next;
   }
-  Log( "%s: got %d EPG events", name.c_str( ), i );
-  channel->SaveConfig( );
-  return true;
+  return i;
+}
+
+void Service::SaveEPG( )
+{
+  if( !channel )
+    return;
+  channel->ExpireEPG( time( NULL ));
+  channel->SaveEPG( );
 }
 
 bool Service::compare( const JSONObject &other, const int &p ) const
@@ -20,18 +20,25 @@
 #include <syslog.h>     // openlog, vsyslog, closelog
 #include <stdarg.h>     // va_start, va_end
 #include <fcntl.h>      // creat
+#include <sys/epoll.h>  // epoll_create, epoll_ctl, epoll_wait
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>    // writev
 
 bool SocketHandler::log2syslog = false;
 
-SocketHandler::SocketHandler() : up(false), connected(false), autoreconnect(false), sd(0), host(NULL), port(0), socket(0)
+SocketHandler::SocketHandler() : up(false), connected(false), autoreconnect(false), sd(0), host(NULL), port(0), socket(0), epfd(-1), num_workers(SOCKETHANDLER_WORKERS), max_clients(0), idle_timeout(0)
 {
   pthread_mutex_init( &mutex, 0 );
+  pthread_cond_init( &queue_cond, 0 );
   logfunc = StdLog;
 }
 
 SocketHandler::~SocketHandler()
 {
   Stop( );
+  pthread_cond_destroy( &queue_cond );
+  pthread_mutex_destroy( &mutex );
 }
 
 bool SocketHandler::CreateClient( SocketType sockettype, const char *host, int port, const char *socket, bool autoreconnect )
@@ -106,6 +113,30 @@ void SocketHandler::Stop( )
   {
     up = false;
     pthread_join( handler, NULL);
+
+    Lock( );
+    pthread_cond_broadcast( &queue_cond );
+    Unlock( );
+    for( std::vector<pthread_t>::iterator it = workers.begin( ); it != workers.end( ); it++ )
+      pthread_join( *it, NULL );
+    workers.clear( );
+    queue.clear( );
+  }
+  for( std::map<int, Client *>::iterator it = clients.begin( ); it != clients.end( ); it++ )
+  {
+    close( it->first );
+    ReleaseBuffer( it->second->rx );
+    delete it->second->message;
+    delete it->second;
+  }
+  clients.clear( );
+  for( std::vector<char *>::iterator it = buffer_pool.begin( ); it != buffer_pool.end( ); it++ )
+    free( *it );
+  buffer_pool.clear( );
+  if( epfd != -1 )
+  {
+    close( epfd );
+    epfd = -1;
   }
   if( sd )
   {
@@ -150,13 +181,39 @@ bool SocketHandler::StartServer( )
     return false;
 
   int backlog = 15;
+  struct epoll_event ev;
   if( listen( sd, backlog ) != 0 )
   {
     SHLogError( "listen failed" );
     goto errorexit;
   }
 
+  epfd = epoll_create1( EPOLL_CLOEXEC );
+  if( epfd == -1 )
+  {
+    SHLogError( "epoll_create failed" );
+    goto errorexit;
+  }
+  memset( &ev, 0, sizeof( ev ));
+  ev.events = EPOLLIN;
+  ev.data.fd = sd;
+  if( epoll_ctl( epfd, EPOLL_CTL_ADD, sd, &ev ) != 0 )
+  {
+    SHLogError( "epoll_ctl failed" );
+    goto errorexit;
+  }
+
   up = true;
+  for( int i = 0; i < num_workers; i++ )
+  {
+    pthread_t worker;
+    if( pthread_create( &worker, NULL, work, (void *) this ) != 0 )
+    {
+      SHLogError( "worker thread creation failed" );
+      goto errorexit;
+    }
+    workers.push_back( worker );
+  }
   if( pthread_create( &handler, NULL, run, (void *) this ) != 0 )
   {
     SHLogError( "thread creation failed" );
@@ -165,6 +222,21 @@ bool SocketHandler::StartServer( )
   return true;
 
 errorexit:
+  if( up )
+  {
+    up = false;
+    Lock( );
+    pthread_cond_broadcast( &queue_cond );
+    Unlock( );
+    for( std::vector<pthread_t>::iterator it = workers.begin( ); it != workers.end( ); it++ )
+      pthread_join( *it, NULL );
+    workers.clear( );
+  }
+  if( epfd != -1 )
+  {
+    close( epfd );
+    epfd = -1;
+  }
   close( sd );
   sd = 0;
   return false;
@@ -278,12 +350,340 @@ void *SocketHandler::run( void *ptr )
   return NULL;
 }
 
+void *SocketHandler::work( void *ptr )
+{
+  SocketHandler *sh = (SocketHandler *) ptr;
+  sh->Work( );
+  pthread_exit( 0 );
+  return NULL;
+}
+
 void SocketHandler::Run( )
+{
+  switch( role )
+  {
+    case SERVER:
+      RunServer( );
+      break;
+    case CLIENT:
+      RunClient( );
+      break;
+  }
+}
+
+void SocketHandler::RunServer( )
+{
+  struct epoll_event events[64];
+  time_t last_expire = time( NULL );
+
+  while( up )
+  {
+    time_t now = time( NULL );
+    if( now != last_expire )
+    {
+      ExpireClients( );
+      last_expire = now;
+    }
+
+    int n = epoll_wait( epfd, events, sizeof( events ) / sizeof( events[0] ), 1000 );
+    if( n == -1 )
+    {
+      if( errno == EINTR )
+        continue;
+      SHLogError( "epoll error" );
+      up = false;
+      continue;
+    }
+
+    for( int i = 0; i < n; i++ )
+    {
+      int fd = events[i].data.fd;
+      if( fd == sd ) // new connection
+      {
+        struct sockaddr_in clientaddr;
+        socklen_t addrlen = sizeof(clientaddr);
+        int newfd;
+        if(( newfd = accept4( sd, (struct sockaddr *) &clientaddr, &addrlen, SOCK_CLOEXEC )) == -1 )
+        {
+          SHLogError( "accept error" );
+          continue;
+        }
+
+        Lock( );
+        size_t count = clients.size( );
+        Unlock( );
+        if( max_clients > 0 && count >= (size_t) max_clients )
+        {
+          SHLogError( "too many connections, rejecting client" );
+          close( newfd );
+          continue;
+        }
+
+        Client *client = new Client( );
+        client->addr = clientaddr;
+        client->message = NULL;
+        client->rx.data = NULL;
+        client->rx.size = client->rx.used = 0;
+        client->last_active = time( NULL );
+        client->timeout = idle_timeout;
+        client->busy = false;
+        client->closing = false;
+        client->error = false;
+        Lock( );
+        clients[newfd] = client;
+        Unlock( );
+
+        Connected( newfd );
+
+        // oneshot: a client is handled by one worker at a time and
+        // re-armed when that worker is done with it
+        struct epoll_event ev;
+        memset( &ev, 0, sizeof( ev ));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.fd = newfd;
+        if( epoll_ctl( epfd, EPOLL_CTL_ADD, newfd, &ev ) != 0 )
+        {
+          SHLogError( "socket %d: epoll_ctl failed", newfd );
+          DisconnectClient( newfd, true );
+          HandleClient( newfd );
+        }
+        continue;
+      }
+
+      Lock( );
+      std::map<int, Client *>::iterator it = clients.find( fd );
+      if( it != clients.end( ))
+        it->second->busy = true;
+      queue.push_back( fd );
+      pthread_cond_signal( &queue_cond );
+      Unlock( );
+    }
+  }
+}
+
+// disconnects clients idle for longer than their timeout; the shutdown
+// wakes up epoll and a worker closes them
+void SocketHandler::ExpireClients( )
+{
+  std::vector<int> expired;
+  time_t now = time( NULL );
+  Lock( );
+  for( std::map<int, Client *>::iterator it = clients.begin( ); it != clients.end( ); it++ )
+  {
+    Client *client = it->second;
+    if( client->timeout > 0 && !client->busy && !client->closing && now - client->last_active > client->timeout )
+      expired.push_back( it->first );
+  }
+  Unlock( );
+
+  for( std::vector<int>::iterator it = expired.begin( ); it != expired.end( ); it++ )
+    DisconnectClient( *it );
+}
+
+void SocketHandler::SetClientTimeout( int client, int seconds )
+{
+  Lock( );
+  std::map<int, Client *>::iterator it = clients.find( client );
+  if( it != clients.end( ))
+    it->second->timeout = seconds;
+  Unlock( );
+}
+
+void SocketHandler::Work( )
+{
+  while( true )
+  {
+    Lock( );
+    while( up && queue.empty( ))
+      pthread_cond_wait( &queue_cond, &mutex );
+    if( !up )
+    {
+      Unlock( );
+      break;
+    }
+    int fd = queue.front( );
+    queue.pop_front( );
+    Unlock( );
+
+    HandleClient( fd );
+  }
+}
+
+void SocketHandler::HandleClient( int fd )
+{
+  Lock( );
+  std::map<int, Client *>::iterator it = clients.find( fd );
+  if( it == clients.end( ))
+  {
+    Unlock( );
+    return;
+  }
+  Client *client = it->second;
+  bool closing = client->closing;
+  Unlock( );
+
+  if( !closing )
+  {
+    int len = Fill( fd, client->rx );
+    if( len <= 0 )
+    {
+      if( len != 0 )
+        SHLogError( "socket %d: error receiving data", fd );
+      DisconnectClient( fd, len != 0 );
+    }
+    else
+      Receive( fd, client->message, client->rx, client );
+  }
+
+  Lock( );
+  closing = client->closing;
+  client->last_active = time( NULL );
+  client->busy = false;
+  Unlock( );
+  if( closing )
+  {
+    CloseClient( fd, client );
+    return;
+  }
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof( ev ));
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  ev.data.fd = fd;
+  if( epoll_ctl( epfd, EPOLL_CTL_MOD, fd, &ev ) != 0 )
+  {
+    SHLogError( "socket %d: epoll_ctl failed", fd );
+    DisconnectClient( fd, true );
+    CloseClient( fd, client );
+  }
+}
+
+// Reads into the connection's buffer, taking one from the pool or growing
+// it as needed. Returns the recv( ) result, -1 if a line exceeds RXBUF_MAX.
+int SocketHandler::Fill( int fd, Buffer &rx )
+{
+  if( !rx.data )
+  {
+    Lock( );
+    if( !buffer_pool.empty( ))
+    {
+      rx.data = buffer_pool.back( );
+      buffer_pool.pop_back( );
+    }
+    Unlock( );
+    if( !rx.data )
+      rx.data = (char *) malloc( RXBUF_SIZE );
+    rx.size = RXBUF_SIZE;
+    rx.used = 0;
+  }
+  else if( rx.used == rx.size )
+  {
+    if( rx.size >= RXBUF_MAX )
+    {
+      SHLogError( "socket %d: line too long", fd );
+      return -1;
+    }
+    char *data = (char *) realloc( rx.data, rx.size * 2 );
+    if( !data )
+      return -1;
+    rx.data = data;
+    rx.size *= 2;
+  }
+
+  int len = recv( fd, rx.data + rx.used, rx.size - rx.used, 0 );
+  if( len > 0 )
+    rx.used += len;
+  return len;
+}
+
+// Parses the pending data of a connection in place. Incomplete lines are
+// left in the buffer until more data arrives.
+bool SocketHandler::Receive( int fd, Message *&message, Buffer &rx, const Client *client )
+{
+  bool ret = true;
+  int pos = 0;
+  while( pos < rx.used && up ) // handle all data
+  {
+    if( client )
+    {
+      Lock( );
+      bool closing = client->closing;
+      Unlock( );
+      if( closing )
+      {
+        ret = false;
+        break;
+      }
+    }
+
+    if( !message )
+      message = CreateMessage( fd );
+
+    int already_read = message->AccumulateData( rx.data + pos, rx.used - pos );
+    if( already_read > rx.used - pos )
+    {
+      // FIXME: log
+      already_read = rx.used - pos;
+    }
+    pos += already_read;
+
+    if( message->isSubmitted( ))
+    {
+      HandleMessage( fd, *message );
+      delete message;
+      message = NULL;
+    }
+    else if( already_read <= 0 )
+      break;
+  }
+
+  rx.used -= pos;
+  if( rx.used > 0 )
+    memmove( rx.data, rx.data + pos, rx.used );
+  else
+    ReleaseBuffer( rx ); // idle connections hold no buffer
+  return ret;
+}
+
+void SocketHandler::ReleaseBuffer( Buffer &rx )
+{
+  if( !rx.data )
+    return;
+  bool pooled = false;
+  if( rx.size == RXBUF_SIZE )
+  {
+    Lock( );
+    if( buffer_pool.size( ) < RXBUF_POOL )
+    {
+      buffer_pool.push_back( rx.data );
+      pooled = true;
+    }
+    Unlock( );
+  }
+  if( !pooled )
+    free( rx.data );
+  rx.data = NULL;
+  rx.size = rx.used = 0;
+}
+
+void SocketHandler::CloseClient( int fd, Client *client )
+{
+  Disconnected( fd, client->error );
+  Lock( );
+  clients.erase( fd );
+  Unlock( );
+  epoll_ctl( epfd, EPOLL_CTL_DEL, fd, NULL );
+  close( fd );
+  ReleaseBuffer( client->rx );
+  delete client->message;
+  delete client;
+}
+
+void SocketHandler::RunClient( )
 {
   fd_set tmp_fds;
-  char buf[2048];
-  int readpos = 0;
-  int writepos = 0;
+  Buffer rx = { NULL, 0, 0 };
+  Message *message = NULL;
 
   FD_ZERO( &fds );
   fdmax = sd;
@@ -291,7 +691,7 @@ void SocketHandler::Run( )
 
   while( up )
   {
-    if( role == CLIENT && !connected )
+    if( !connected )
     {
       if( !Connect( ))
       {
@@ -325,140 +725,41 @@ void SocketHandler::Run( )
       continue;
     }
 
-    switch( role )
+    if( FD_ISSET( sd, &tmp_fds ))
     {
-      case SERVER:
-        for( int i = 0; i <= fdmax; i++ )
-        {
-          if( FD_ISSET( i, &tmp_fds ))
-          {
-            if( i == sd ) // new connection
-            {
-              struct sockaddr_in clientaddr;
-              socklen_t addrlen = sizeof(clientaddr);
-              int newfd;
-              if(( newfd = accept( sd, (struct sockaddr *) &clientaddr, &addrlen )) == -1 )
-              {
-                SHLogError( "accept error" );
-                continue;
-              }
-
-              Lock( );
-              clients[newfd] = clientaddr;
-              Unlock( );
-
-              FD_SET( newfd, &fds );
-              if( newfd > fdmax )
-                fdmax = newfd;
-
-              Connected( newfd );
-            }
-            else // handle data
-            {
-              int len = recv( i, buf + writepos, sizeof( buf ) - writepos, 0 );
-              if( len <= 0 )
-              {
-                if( len != 0 )
-                  SHLogError( "socket %d: error receiving data", i );
-                DisconnectClient( i, len != 0 );
-              }
-              else
-              {
-                writepos += len;
-                if( writepos == sizeof( buf ))
-                  writepos = 0;
-                int already_read;
-                while( readpos != writepos && up ) // handle all data
-                {
-                  if( !messages[i] )
-                    messages[i] = CreateMessage( i );
-
-                  already_read = messages[i]->AccumulateData( buf + readpos, len );
-                  if( already_read > len )
-                  {
-                    // FIXME: log
-                    already_read = len;
-                  }
-
-                  if( messages[i]->isSubmitted( ))
-                  {
-                    HandleMessage( i, *messages[i] );
-                    delete messages[i];
-                    messages[i] = NULL;
-                  }
-                  len     -= already_read;
-                  readpos += already_read;
-                  if( readpos == sizeof( buf ))
-                    readpos = 0;
-                  //SHLogError( "writepos: %d, readpos: %d\n", writepos, readpos );
-                }
-              }
-            }
-          } // if( FD_ISSET( i, &tmp_fds ))
-        } // for( int i = 0; i <= fdmax; i++ )
-        break;
-
-      case CLIENT:
-        if( FD_ISSET( sd, &tmp_fds ))
+      int len = Fill( sd, rx );
+      if( len <= 0 )
+      {
+        if( len != 0 )
+          SHLogError( "socket %d: error receiving data", sd );
+        Disconnected( sd, len != 0 );
+        connected = false;
+        FD_CLR( sd, &fds );
+        close( sd );
+        sd = 0;
+        delete message;
+        message = NULL;
+        ReleaseBuffer( rx );
+        if( autoreconnect )
         {
-          int len = recv( sd, buf + writepos, sizeof( buf ) - writepos, 0 );
-          if( len <= 0 )
-          {
-            if( len != 0 )
-              SHLogError( "socket %d: error receiving data", sd );
-            Disconnected( sd, len != 0 );
-            connected = false;
-            close( sd );
-            sd = 0;
-            if( autoreconnect )
-            {
-              if( !CreateSocket( ))
-                up = false;
-              {
-                fdmax = sd;
-                FD_SET ( sd, &fds );
-              }
-            }
-            else
-            {
-              up = false;
-            }
-          }
-          else
+          if( !CreateSocket( ))
+            up = false;
           {
-            writepos += len;
-            if( writepos == sizeof( buf ))
-              writepos = 0;
-            int already_read;
-            while( readpos != writepos && up ) // handle all data
-            {
-              if( !messages[sd] )
-                messages[sd] = CreateMessage( sd );
-
-              already_read = messages[sd]->AccumulateData( buf + readpos, len );
-              if( already_read > len )
-              {
-                // FIXME: log
-                already_read = len;
-              }
-
-              if( messages[sd]->isSubmitted( ))
-              {
-                HandleMessage( sd, *messages[sd] );
-                delete messages[sd];
-                messages[sd] = NULL;
-              }
-              len     -= already_read;
-              readpos += already_read;
-              if( readpos == sizeof( buf ))
-                readpos = 0;
-              //Log( "writepos: %d, readpos: %d\n", writepos, readpos );
-            }
+            fdmax = sd;
+            FD_SET ( sd, &fds );
           }
         }
-        break;
-    } // switch( type )
+        else
+        {
+          up = false;
+        }
+      }
+      else
+        Receive( sd, message, rx, NULL );
+    }
   } // while( up )
+  delete message;
+  ReleaseBuffer( rx );
 }
 
 bool SocketHandler::Send( const char *buffer, int len )
@@ -469,7 +770,7 @@ bool SocketHandler::Send( const char *buffer, int len )
   int written = 0;
   while( written < len )
   {
-    int n = write( sd, buffer, len );
+    int n = write( sd, buffer + written, len - written );
     if( n < 0 )
     {
       SHLogError( "error writing to socket" );
@@ -484,6 +785,49 @@ bool SocketHandler::Send( const char *buffer, int len )
   return true;
 }
 
+// sends header and content with a single syscall where possible
+bool SocketHandler::SendToClient( int client, const char *header, int header_len, const char *content, int content_len )
+{
+  if( role != SERVER )
+    return false;
+
+  struct iovec iov[2];
+  iov[0].iov_base = (void *) header;
+  iov[0].iov_len  = header_len;
+  iov[1].iov_base = (void *) content;
+  iov[1].iov_len  = content_len;
+  int i = 0;
+  while( i < 2 )
+  {
+    if( iov[i].iov_len == 0 )
+    {
+      i++;
+      continue;
+    }
+    ssize_t n = writev( client, iov + i, 2 - i );
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n < 0 )
+    {
+      SHLogError( "error writing to socket" );
+      DisconnectClient( client );
+      return false;
+    }
+    while( i < 2 && (size_t) n >= iov[i].iov_len )
+    {
+      n -= iov[i].iov_len;
+      iov[i].iov_len = 0;
+      i++;
+    }
+    if( i < 2 )
+    {
+      iov[i].iov_base = (char *) iov[i].iov_base + n;
+      iov[i].iov_len -= n;
+    }
+  }
+  return true;
+}
+
 bool SocketHandler::SendToClient( int client, const char *buffer, int len )
 {
   if( role != SERVER )
@@ -492,7 +836,7 @@ bool SocketHandler::SendToClient( int client, const char *buffer, int len )
   int written = 0;
   while( written < len )
   {
-    int n = write( client, buffer, len );
+    int n = write( client, buffer + written, len - written );
     if( n < 0 )
     {
       SHLogError( "error writing to socket" );
@@ -504,14 +848,36 @@ bool SocketHandler::SendToClient( int client, const char *buffer, int len )
   return true;
 }
 
+// sends len bytes of the file fd from offset without copying them to userspace
+bool SocketHandler::SendFileToClient( int client, int fd, off_t offset, size_t len )
+{
+  if( role != SERVER )
+    return false;
+
+  while( len > 0 )
+  {
+    ssize_t n = sendfile( client, fd, &offset, len );
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n <= 0 )
+    {
+      SHLogError( "error sending file to socket" );
+      DisconnectClient( client );
+      return false;
+    }
+    len -= n;
+  }
+  return true;
+}
+
 bool SocketHandler::Lock( ) const
 {
-  pthread_mutex_lock( &mutex );
+  return pthread_mutex_lock( &mutex ) == 0;
 }
 
 bool SocketHandler::Unlock( ) const
 {
-  pthread_mutex_unlock( &mutex );
+  return pthread_mutex_unlock( &mutex ) == 0;
 }
 
 void SocketHandler::Dump( const char *buffer, int length )
@@ -526,34 +892,28 @@ SocketHandler::Message *SocketHandler::CreateMessage( int /* client */ ) const
   return new Message( );
 }
 
+// Takes one complete line from the connection buffer, 0 if none is there yet.
 int SocketHandler::Message::AccumulateData( const char *buffer, int length )
 {
-  bool end = false;
-  int i;
-  //  Log( "accumulating data: " );
-  //  Dump( buffer, length );
-  for( i = 0; i < length; i++ )
-  {
-    if( buffer[i] == '\0' ||  buffer[i] == '\n' ) // ||  buffer[i] == '\r' )
-    {
-      end = true;
-      i++;
+  int end;
+  for( end = 0; end < length; end++ )
+    if( buffer[end] == '\0' || buffer[end] == '\n' )
       break;
-    }
-    else if( buffer[i] == '\r' )
-      continue;
-    else
+  if( end == length )
+    return 0;
+
+  line.reserve( line.length( ) + end );
+  int start = 0;
+  for( int i = 0; i <= end; i++ )
+  {
+    if( i == end || buffer[i] == '\r' )
     {
-      if( end )
-        break;
-      line += buffer[i];
+      line.append( buffer + start, i - start );
+      start = i + 1;
     }
   }
-  if( end )
-  {
-    Submit( );
-  }
-  return i;
+  Submit( );
+  return end + 1;
 }
 
 void SocketHandler::Message::Submit( )
@@ -569,14 +929,21 @@ void SocketHandler::Message::Submit( )
   submitted = true;
 }
 
+// The socket is shut down here and closed by the worker owning the client
+// once it is done with it, so the fd cannot be reused under its feet.
 void SocketHandler::DisconnectClient( int client, bool error )
 {
-  Disconnected( client, error );
   Lock( );
-  clients.erase( client );
+  std::map<int, Client *>::iterator it = clients.find( client );
+  if( it == clients.end( ) || it->second->closing )
+  {
+    Unlock( );
+    return;
+  }
+  it->second->closing = true;
+  it->second->error = error;
   Unlock( );
-  close( client );
-  FD_CLR( client, &fds );
+  shutdown( client, SHUT_RDWR );
 }
 
 static const struct loglevel
@@ -617,10 +984,10 @@ bool SocketHandler::GetClientAddress( int client, struct sockaddr_in &addr ) con
 {
   bool ret = false;
   Lock( );
-  std::map<int, struct sockaddr_in>::const_iterator it = clients.find( client );
+  std::map<int, Client *>::const_iterator it = clients.find( client );
   if( it != clients.end( ))
   {
-    addr = it->second;
+    addr = it->second->addr;
     ret = true;
   }
   Unlock( );
@@ -26,6 +26,8 @@
 
 #include "TVDaemon.h"
 #include "Transponder.h"
+#include "Transponder_DVBT.h"
+#include "Transponder_DVBC.h"
 #include "Adapter.h"
 #include "Frontend.h"
 #include "Port.h"
@@ -161,9 +163,13 @@ bool Source::ReadScanfile( std::string scanfile )
   return true;
 }
 
+int Source::GetAvailableTransponderKey( )
+{
+  return GetAvailableKey<Transponder, int>( transponders );
+}
+
 bool Source::AddTransponder( Transponder *t )
 {
-  SCOPELOCK( );
   for( std::map<int, Transponder *>::iterator it = transponders.begin( ); it != transponders.end( ); it++ )
   {
     if( it->second->IsSame( *t ))
@@ -172,11 +178,26 @@ bool Source::AddTransponder( Transponder *t )
       return false;
     }
   }
-  int next_id = GetAvailableKey<Transponder, int>( transponders );
-  transponders[next_id] = t;
+  transponders[t->GetKey( )] = t;
   return true;
 }
 
+void Source::RemoveTransponder( Transponder *t )
+{
+  Lock( );
+  for( std::map<int, Transponder *>::iterator it = transponders.begin( ); it != transponders.end( ); it++ )
+  {
+    if( it->second == t )
+    {
+      transponders.erase( it );
+      break;
+    }
+  }
+  Unlock( );
+  t->Delete( );
+  delete t;
+}
+
 Transponder *Source::CreateTransponder( const struct dvb_entry &info )
 {
   Lock( );
@@ -224,10 +245,10 @@ Transponder *Source::CreateTransponder( const struct dvb_entry &info )
     }
   }
   Log( "Creating Transponder: %s, %d", delivery_system_name[delsys], frequency );
-  Transponder *t = Transponder::Create( *this, delsys, transponders.size( ));
+  int next_id = GetAvailableKey<Transponder, int>( transponders );
+  Transponder *t = Transponder::Create( *this, delsys, next_id );
   if( t )
   {
-    int next_id = GetAvailableKey<Transponder, int>( transponders );
     transponders[next_id] = t;
     for( int i = 0; i < info.n_props; i++ )
       t->AddProperty( info.props[i] );
@@ -358,6 +379,25 @@ bool Source::RPC( const HTTPRequest &request, const std::string &cat, const std:
 
       return true;
     }
+
+    if( action == "blind_scan" )
+    {
+      int from, to, step, bandwidth = 0, symbol_rate = BLIND_SCAN_SYMBOL_RATE; // kHz, symbols/s
+      if( !request.GetParam( "from", from ) or !request.GetParam( "to", to ) or !request.GetParam( "step", step ))
+        return false;
+      if( request.HasParam( "bandwidth" ))
+        request.GetParam( "bandwidth", bandwidth );
+      if( request.HasParam( "symbol_rate" ))
+        request.GetParam( "symbol_rate", symbol_rate );
+      if( from <= 0 or to < from or step <= 0 or bandwidth < 0 )
+      {
+        request.NotFound( "RPC source: invalid blind scan range" );
+        return false;
+      }
+      BlindScan( from * 1000, to * 1000, step * 1000, bandwidth * 1000, symbol_rate );
+      request.Reply( HTTP_OK );
+      return true;
+    }
   }
 
   if( cat == "transponder" || cat == "service" )
@@ -455,6 +495,38 @@ void Source::Scan( )
       it->second->SetState( Transponder::State_New );
 }
 
+int Source::BlindScan( uint32_t from, uint32_t to, uint32_t step, uint32_t bandwidth, uint32_t symbol_rate )
+{
+  if( step == 0 or from > to )
+    return 0;
+  if( type != Type_DVBT and type != Type_DVBC )
+  {
+    LogError( "Blind scan is only supported on DVB-T and DVB-C" );
+    return 0;
+  }
+
+  SCOPELOCK( );
+  int count = 0;
+  for( uint32_t frequency = from; frequency <= to; frequency += step )
+  {
+    Transponder *t;
+    if( type == Type_DVBT )
+      t = new Transponder_DVBT( *this, SYS_DVBT, frequency, bandwidth, FEC_AUTO, FEC_AUTO, QAM_AUTO,
+                                TRANSMISSION_MODE_AUTO, GUARD_INTERVAL_AUTO, HIERARCHY_AUTO, GetAvailableTransponderKey( ));
+    else
+      t = new Transponder_DVBC( *this, frequency, symbol_rate, FEC_AUTO, QAM_AUTO, GetAvailableTransponderKey( ));
+    t->SetProbe( true );
+    if( !AddTransponder( t ))
+    {
+      delete t;
+      continue;
+    }
+    count++;
+  }
+  Log( "Blind scan: %d frequencies to probe", count );
+  return count;
+}
+
 bool Source::GetTransponderForScanning( Activity &act )
 {
   SCOPELOCK( );
@@ -473,21 +545,34 @@ bool Source::GetTransponderForEPGScan( Activity &act )
 {
   SCOPELOCK( );
   time_t now = time( NULL );
+  Transponder *best = NULL;
+  double best_score = -1.0;
+  // all frontends of this source pick from here: prefer the transponder
+  // with the most stale EPG, weighted by how often its channels are watched
   for( std::map<int, Transponder *>::const_iterator it = transponders.begin( ); act.IsActive( ) && it != transponders.end( ); it++ )
   {
-    if(it->second->HasChannels( ) &&
-       it->second->GetEPGState( ) != Transponder::EPGState_Updating &&
-       (it->second->LastEPGUpdate( ) == 0 or difftime( now, it->second->LastEPGUpdate( )) >= TVDaemon::Instance( )->GetEPGUpdateInterval( )) and
-        (it->second->LastEPGFailed( ) == 0 or difftime( now, it->second->LastEPGFailed( )) >= 3600.0 ))
+    Transponder *t = it->second;
+    if( !t->HasChannels( ) or
+        t->GetEPGState( ) == Transponder::EPGState_Updating or
+        t->IsCollecting( ))
+      continue;
+    if( t->LastEPGFailed( ) != 0 and difftime( now, t->LastEPGFailed( )) < 3600.0 )
+      continue;
+    double age = t->LastEPGUpdate( ) == 0 ? difftime( now, 0 ) : difftime( now, t->LastEPGUpdate( ));
+    if( t->LastEPGUpdate( ) != 0 and age < TVDaemon::Instance( )->GetEPGUpdateInterval( ))
+      continue;
+    double score = age * ( 1 + t->GetPopularity( ));
+    if( score > best_score )
     {
-      it->second->SetEPGState( Transponder::EPGState_Updating );
-      act.SetTransponder( it->second );
-      return true;
+      best = t;
+      best_score = score;
     }
-    //else
-      //Log( "Last: %d %f >= %d, failed: %d %f : %d", (*it)->LastEPGUpdate( ), difftime( now, (*it)->LastEPGUpdate( )), TVDaemon::Instance( )->GetEPGUpdateInterval( ), (*it)->LastEPGFailed( ), difftime( now, (*it)->LastEPGFailed( )), (*it)->GetEPGState( ));
   }
-  return false;
+  if( !best )
+    return false;
+  best->SetEPGState( Transponder::EPGState_Updating );
+  act.SetTransponder( best );
+  return true;
 }
 
 bool Source::compare( const JSONObject &other, const int &p ) const
@@ -30,10 +30,11 @@
 
 #include <libdvbv5/pmt.h>
 
-Stream::Stream( Service &service, uint16_t id, Type type, int config_id ) :
+Stream::Stream( Service &service, uint16_t id, Type type, const std::string &language, int config_id ) :
   service(service),
   id(id),
   type(type),
+  language(language),
   up(false)
 {
 }
@@ -51,15 +52,17 @@ Stream::~Stream( )
 
 bool Stream::SaveConfig( ConfigBase &config )
 {
-  config.WriteConfig( "ID",   id );
-  config.WriteConfig( "Type", type );
+  config.WriteConfig( "ID",       id );
+  config.WriteConfig( "Type",     type );
+  config.WriteConfig( "Language", language );
   return true;
 }
 
 bool Stream::LoadConfig( ConfigBase &config )
 {
-  config.ReadConfig( "ID",   id );
-  config.ReadConfig( "Type", (int &) type );
+  config.ReadConfig( "ID",       id );
+  config.ReadConfig( "Type",     (int &) type );
+  config.ReadConfig( "Language", language );
   return true;
 }
 
@@ -137,15 +140,21 @@ int Stream::GetTypeMPEG( )
   return -1;
 }
 
-bool Stream::Update( Type type )
+bool Stream::Update( Type type, const std::string &language )
 {
+  bool ret = true;
   if( type != this->type )
   {
     LogWarn( "Stream %d type changed from %s (%d) to %s (%d)", id, GetTypeName( this->type ), this->type, GetTypeName( type ), type );
     this->type = type;
-    return false;
+    ret = false;
   }
-  return true;
+  if( language != this->language )
+  {
+    this->language = language;
+    ret = false;
+  }
+  return ret;
 }
 
 void Stream::json( json_object *entry ) const
@@ -153,6 +162,7 @@ void Stream::json( json_object *entry ) const
   json_object_object_add( entry, "id",        json_object_new_int( GetKey( )));
   json_object_object_add( entry, "pid",       json_object_new_int( id ));
   json_object_object_add( entry, "type",      json_object_new_int( type ));
+  json_object_object_add( entry, "language",  json_object_new_string( language.c_str( )));
 }
 
 void Stream::HandleData( uint8_t *data, ssize_t len )
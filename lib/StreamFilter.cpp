@@ -0,0 +1,143 @@
+/*
+ *  tvdaemon
+ *
+ *  StreamFilter class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StreamFilter.h"
+
+#include "Stream.h"
+#include "ConfigObject.h"
+#include "HTTPServer.h"
+#include "Utils.h"
+#include "JSONWriter.h"
+
+#include <algorithm> // find
+
+StreamFilter::StreamFilter( ) : first_video_only(false)
+{
+}
+
+StreamFilter::~StreamFilter( )
+{
+}
+
+void StreamFilter::SetAudioLanguages( const std::string &languages )
+{
+  std::vector<std::string> tokens;
+  Utils::Tokenize( languages, ", ", tokens );
+  audio_languages.clear( );
+  for( std::vector<std::string>::iterator it = tokens.begin( ); it != tokens.end( ); it++ )
+  {
+    std::string lang;
+    Utils::ToLower( Utils::Trim( *it ), lang );
+    if( !lang.empty( ))
+      audio_languages.push_back( lang );
+  }
+}
+
+std::string StreamFilter::GetAudioLanguages( ) const
+{
+  std::string languages;
+  for( std::vector<std::string>::const_iterator it = audio_languages.begin( ); it != audio_languages.end( ); it++ )
+  {
+    if( !languages.empty( ))
+      languages += ",";
+    languages += *it;
+  }
+  return languages;
+}
+
+void StreamFilter::Apply( std::map<uint16_t, Stream *> &streams, std::vector<Stream *> &result ) const
+{
+  std::vector<Stream *> audio, matching;
+  bool have_video = false;
+
+  result.clear( );
+  for( std::map<uint16_t, Stream *>::iterator it = streams.begin( ); it != streams.end( ); it++ )
+  {
+    Stream *s = it->second;
+    if( s->IsVideo( ))
+    {
+      if( first_video_only && have_video )
+        continue;
+      have_video = true;
+      result.push_back( s );
+    }
+    else if( s->IsAudio( ))
+    {
+      audio.push_back( s );
+      std::string lang;
+      Utils::ToLower( s->GetLanguage( ), lang );
+      if( std::find( audio_languages.begin( ), audio_languages.end( ), lang ) != audio_languages.end( ))
+        matching.push_back( s );
+    }
+    // everything else (teletext, subtitles, data) is not recorded
+  }
+
+  if( audio_languages.empty( ))
+    result.insert( result.end( ), audio.begin( ), audio.end( ));
+  else if( !matching.empty( ))
+    result.insert( result.end( ), matching.begin( ), matching.end( ));
+  else if( !audio.empty( ))
+    result.push_back( audio.front( )); // no language matched, do not record silence
+}
+
+bool StreamFilter::SaveConfig( ConfigBase &config )
+{
+  std::string languages = GetAudioLanguages( );
+  config.WriteConfig( "FirstVideoOnly", first_video_only );
+  config.WriteConfig( "AudioLanguages", languages );
+  return true;
+}
+
+bool StreamFilter::LoadConfig( ConfigBase &config )
+{
+  std::string languages;
+  config.ReadConfig( "FirstVideoOnly", first_video_only );
+  config.ReadConfig( "AudioLanguages", languages );
+  SetAudioLanguages( languages );
+  return true;
+}
+
+void StreamFilter::json( json_object *entry ) const
+{
+  json_object_object_add( entry, "first_video_only", json_object_new_boolean( first_video_only ));
+  json_object_object_add( entry, "audio_languages",  json_object_new_string( GetAudioLanguages( ).c_str( )));
+}
+
+void StreamFilter::serialize( JSONWriter &writer ) const
+{
+  writer.AddBool( "first_video_only", first_video_only );
+  writer.Add( "audio_languages", GetAudioLanguages( ));
+}
+
+void StreamFilter::Set( const HTTPRequest &request )
+{
+  std::string t;
+  if( request.HasParam( "first_video_only" ))
+  {
+    request.GetParam( "first_video_only", t );
+    first_video_only = t == "1" || t == "true";
+  }
+  if( request.HasParam( "audio_languages" ))
+  {
+    request.GetParam( "audio_languages", t );
+    SetAudioLanguages( t );
+  }
+}
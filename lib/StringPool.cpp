@@ -0,0 +1,93 @@
+/*
+ *  tvdaemon
+ *
+ *  StringPool class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StringPool.h"
+
+StringPool &StringPool::Instance( )
+{
+  static StringPool pool;
+  return pool;
+}
+
+StringPool::Entry *StringPool::Get( const std::string &s )
+{
+  if( s.empty( ))
+    return NULL;
+  SCOPELOCK( );
+  Entry &entry = *strings.insert( std::make_pair( s, 0 )).first;
+  entry.second++;
+  return &entry;
+}
+
+void StringPool::Ref( Entry *entry )
+{
+  if( !entry )
+    return;
+  SCOPELOCK( );
+  entry->second++;
+}
+
+void StringPool::Unref( Entry *entry )
+{
+  if( !entry )
+    return;
+  SCOPELOCK( );
+  if( --entry->second == 0 )
+    strings.erase( strings.find( entry->first ));
+}
+
+const std::string InternedString::none;
+
+InternedString::InternedString( const std::string &s ) : entry(StringPool::Instance( ).Get( s ))
+{
+}
+
+InternedString::InternedString( const char *s ) : entry(StringPool::Instance( ).Get( s ))
+{
+}
+
+InternedString::InternedString( const InternedString &other ) : entry(other.entry)
+{
+  StringPool::Instance( ).Ref( entry );
+}
+
+InternedString::~InternedString( )
+{
+  StringPool::Instance( ).Unref( entry );
+}
+
+InternedString &InternedString::operator=( const InternedString &other )
+{
+  if( entry == other.entry )
+    return *this;
+  StringPool::Instance( ).Ref( other.entry );
+  StringPool::Instance( ).Unref( entry );
+  entry = other.entry;
+  return *this;
+}
+
+InternedString &InternedString::operator=( const std::string &s )
+{
+  StringPool::Entry *e = StringPool::Instance( ).Get( s );
+  StringPool::Instance( ).Unref( entry );
+  entry = e;
+  return *this;
+}
@@ -0,0 +1,138 @@
+/*
+ *  tvdaemon
+ *
+ *  TSMonitor class
+ *
+ *  Copyright (C) 2014 André Roth
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TSMonitor.h"
+
+#include <string.h> // memset
+
+#define TS_PACKET_SIZE 188
+#define TS_NULL_PID    0x1FFF
+
+TSMonitor::TSMonitor( ) : parent(NULL)
+{
+  Reset( );
+}
+
+TSMonitor::~TSMonitor( )
+{
+}
+
+void TSMonitor::Reset( TSMonitor *parent )
+{
+  SCOPELOCK( );
+  this->parent = parent;
+  memset( &counters, 0, sizeof( counters ));
+  memset( cc, 0xFF, sizeof( cc ));
+  since = time( NULL );
+}
+
+void TSMonitor::Process( const uint8_t *data, size_t len )
+{
+  Counters delta;
+  memset( &delta, 0, sizeof( delta ));
+
+  Lock( );
+  for( const uint8_t *p = data; p + TS_PACKET_SIZE <= data + len; p += TS_PACKET_SIZE )
+  {
+    delta.packets++;
+    if( p[0] != 0x47 )
+    {
+      delta.sync_errors++;
+      continue;
+    }
+    if( p[1] & 0x80 ) // transport error indicator, the header is not reliable
+    {
+      delta.tei_errors++;
+      continue;
+    }
+    if( p[3] & 0xC0 )
+      delta.scrambled++;
+
+    uint16_t pid = (( p[1] & 0x1F ) << 8 ) | p[2];
+    if( pid == TS_NULL_PID )
+      continue;
+
+    uint8_t adaptation = ( p[3] >> 4 ) & 0x03;
+    uint8_t counter = p[3] & 0x0F;
+    if( adaptation & 0x02 && p[4] > 0 && p[5] & 0x80 ) // discontinuity indicator
+      cc[pid] = 0xFF;
+    if( !( adaptation & 0x01 )) // no payload, counter does not advance
+      continue;
+
+    uint8_t last = cc[pid];
+    cc[pid] = counter;
+    if( last == 0xFF || counter == last ) // unknown or duplicate packet
+      continue;
+    if( counter != (( last + 1 ) & 0x0F ))
+      delta.cc_errors++;
+  }
+  Unlock( );
+
+  Add( delta );
+}
+
+void TSMonitor::Overflow( )
+{
+  Counters delta;
+  memset( &delta, 0, sizeof( delta ));
+  delta.overflows = 1;
+
+  // the kernel dropped data, counters cannot be followed anymore
+  Lock( );
+  memset( cc, 0xFF, sizeof( cc ));
+  Unlock( );
+
+  Add( delta );
+}
+
+void TSMonitor::Add( const Counters &delta )
+{
+  Lock( );
+  counters.packets     += delta.packets;
+  counters.sync_errors += delta.sync_errors;
+  counters.cc_errors   += delta.cc_errors;
+  counters.tei_errors  += delta.tei_errors;
+  counters.scrambled   += delta.scrambled;
+  counters.overflows   += delta.overflows;
+  TSMonitor *p = parent;
+  Unlock( );
+
+  if( p )
+    p->Add( delta );
+}
+
+void TSMonitor::json( json_object *j ) const
+{
+  SCOPELOCK( );
+  time_t duration = time( NULL ) - since;
+  uint64_t errors = counters.sync_errors + counters.cc_errors + counters.tei_errors + counters.overflows;
+
+  json_object_object_add( j, "packets",     json_object_new_int64( counters.packets ));
+  json_object_object_add( j, "sync_errors", json_object_new_int64( counters.sync_errors ));
+  json_object_object_add( j, "cc_errors",   json_object_new_int64( counters.cc_errors ));
+  json_object_object_add( j, "tei_errors",  json_object_new_int64( counters.tei_errors ));
+  json_object_object_add( j, "scrambled",   json_object_new_int64( counters.scrambled ));
+  json_object_object_add( j, "overflows",   json_object_new_int64( counters.overflows ));
+  json_object_object_add( j, "duration",    json_object_new_int( duration ));
+  // errors per minute and per million packets
+  json_object_object_add( j, "error_rate",  json_object_new_double( duration > 0 ? errors * 60.0 / duration : 0.0 ));
+  json_object_object_add( j, "error_ppm",   json_object_new_double( counters.packets > 0 ? errors * 1e6 / counters.packets : 0.0 ));
+}
@@ -172,6 +172,7 @@ bool TVDaemon::Start( const char* httpRoot )
   httpd->AddDynamicHandler( "tvd", this );
   httpd->SetRTSPHandler( this );
   httpd->SetLogFunc( TVD_Log );
+  httpd->PreloadFiles( );
 
   if( !httpd->CreateServerTCP( HTTPDPORT ))
   {
@@ -587,7 +588,7 @@ void TVDaemon::Run( )
 
 Source *TVDaemon::CreateSource( const std::string &name, Source::Type type, std::string scanfile )
 {
-  // FIXME lock sources
+  ScopeLock _l( mutex_sources );
   for( std::map<int, Source *>::iterator it = sources.begin( ); it != sources.end( ); it++ )
   {
     if( it->second->GetName( ) == name )
@@ -597,7 +598,6 @@ Source *TVDaemon::CreateSource( const std::string &name, Source::Type type, std:
     }
   }
 
-  // FIXME: lock
   Source *s = new Source( *this, name, type, sources.size( ));
 
   if( scanfile != "" )
@@ -723,6 +723,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
 {
   if( action == "get_sources" )
   {
+    ScopeLock _l( mutex_sources );
     json_object *h = json_object_new_object();
     json_object_object_add( h, "iTotalRecords", json_object_new_int( sources.size( )));
     json_object *a = json_object_new_array();
@@ -874,6 +875,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
       Utils::ToLower( t, search );
     }
 
+    SCOPELOCK( ); // channels
     std::vector<const JSONObject *> result;
     for( std::map<int, Channel *>::iterator it = channels.begin( ); it != channels.end( ); it++ )
     {
@@ -907,13 +909,19 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
       return false;
 
     int i = atoi( t.c_str( ));
-    return RemoveChannel( i );
+    if( !RemoveChannel( i ))
+    {
+      request.NotFound( "RPC unknown channel: %d", i );
+      return false;
+    }
+    request.Reply( HTTP_OK );
+    return true;
   }
 
   if( action == "get_playlist" )
   {
     std::string referer, server;
-    if( request.GetHeader( "Referer", referer ))
+    if( request.HasHeader( "Referer" ) and request.GetHeader( "Referer", referer ))
     {
       std::vector<std::string> tokens;
       Utils::Tokenize( referer, "/", tokens, 3 );
@@ -938,6 +946,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
       server = t;
     }
 
+    SCOPELOCK( ); // channels
     std::string xspf = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n\
 <playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n\
   <trackList>\n";
@@ -976,6 +985,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
       Utils::ToLower( t, search );
     }
 
+    ScopeLock _l( mutex_sources );
     std::vector<const JSONObject *> result;
     for( std::map<int, Source *>::iterator it = sources.begin( ); it != sources.end( ); it++ )
     {
@@ -1003,6 +1013,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
       Utils::ToLower( t, search );
     }
 
+    ScopeLock _l( mutex_sources );
     std::vector<const JSONObject *> result;
     for( std::map<int, Source *>::iterator it = sources.begin( ); it != sources.end( ); it++ )
     {
@@ -1026,33 +1037,46 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
   {
     std::string search;
     if( request.HasParam( "search" ))
+      request.GetParam( "search", search );
+
+    // time window as unix timestamps, defaults to everything not yet ended
+    int from = time( NULL );
+    if( request.HasParam( "from" ))
+      request.GetParam( "from", from );
+    int to = 0;
+    if( request.HasParam( "to" ))
+      request.GetParam( "to", to );
+
+    Channel *channel = NULL;
+    if( request.HasParam( "channel_id" ))
     {
-      std::string t;
-      request.GetParam( "search", t );
-      Utils::ToLower( t, search );
+      int channel_id;
+      request.GetParam( "channel_id", channel_id );
+      channel = GetChannel( channel_id );
+      if( !channel )
+      {
+        request.NotFound( "RPC unknown channel: %d", channel_id );
+        return false;
+      }
     }
 
-    std::vector<const JSONObject *> result;
-    for( std::map<int, Channel *>::iterator it = channels.begin( ); it != channels.end( ); it++ )
+    // serialize while the store is locked, events may expire any time
+    std::string json;
+    if( request.HasParam( "now_next" ) or !search.empty( ))
     {
-      const std::vector<Event *> &events = it->second->GetEvents( );
-      for( std::vector<Event *>::const_iterator it2 = events.begin( ); it2 != events.end( ); it2++ )
-      {
-        //Log( "time : %d", time( NULL ));
-        //Log( "start: %d", (*it2)->GetStart( ));
-        if( difftime((*it2)->GetEnd( ), time( NULL )) <= 0.0 ) // FIXME: stop
-          continue;
-        const Name &name = (*it2)->GetName( );
-        const Name &description = (*it2)->GetDescription( );
-        const Name &channel = (*it2)->GetChannel( ).GetName( );
-        if( !search.empty( ) and name.find( search.c_str( ), 0, search.length( )) == std::string::npos
-            and description.find( search.c_str( ), 0, search.length( )) == std::string::npos
-            and channel.find( search.c_str( ), 0, search.length( )) == std::string::npos )
-          continue;
-        result.push_back( *it2 );
-      }
+      EPGStore::Result result( epg_store );
+      if( request.HasParam( "now_next" ))
+        result.NowNext( from, channel, search );
+      else
+        result.Search( search, channel, from, to );
+      WriteTable( request, result, json );
     }
-    ServerSideTable( request, result );
+    else
+    {
+      EPGStore::Cursor cursor( epg_store, channel, from, to );
+      WriteTable( request, cursor, json );
+    }
+    request.ReplyJSON( json );
     return true;
   }
 
@@ -1065,16 +1089,22 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
       //request.GetParam( "search", t );
       //Utils::ToLower( t, search );
     //}
-    std::vector<const JSONObject *> result;
-    Recorder::Instance( )->GetRecordings( result );
-    ServerSideTable( request, result );
+    std::string json;
+    {
+      // recordings may be removed by other requests, serialize them locked
+      Recorder::Recordings recordings( *Recorder::Instance( ));
+      WriteTable( request, recordings.data, json );
+    }
+    request.ReplyJSON( json );
     return true;
   }
 
   if( action == "scan" )
   {
+    LockSources( );
     for( std::map<int, Source *>::iterator it = sources.begin( ); it != sources.end( ); it++ )
       it->second->Scan( );
+    UnlockSources( );
     request.Reply( HTTP_OK );
     return true;
   }
@@ -1090,10 +1120,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
   {
     int adapter_id;
     if( !request.GetParam( "id", adapter_id ))
-    {
-      request.NotFound( "id missing" );
       return false;
-    }
     LockAdapters( );
     std::map<int, Adapter *>::iterator it = adapters.find( adapter_id );
     if( it == adapters.end( ))
@@ -1106,7 +1133,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
     delete it->second;
     adapters.erase( it );
     UnlockAdapters( );
-
+    request.Reply( HTTP_OK );
     return true;
   }
 
@@ -1114,10 +1141,7 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
   {
     int source_id;
     if( !request.GetParam( "id", source_id ))
-    {
-      request.NotFound( "id missing" );
       return false;
-    }
     LockSources( );
     std::map<int, Source *>::iterator it = sources.find( source_id );
     if( it == sources.end( ))
@@ -1131,51 +1155,101 @@ bool TVDaemon::RPC( const HTTPRequest &request, const std::string &cat, const st
     delete it->second;
     sources.erase( it );
     UnlockSources( );
+    request.Reply( HTTP_OK );
     return true;
   }
   request.NotFound( "RPC unknown action: %s", action.c_str( ));
   return false;
 }
 
-void TVDaemon::ServerSideTable( const HTTPRequest &request, std::vector<const JSONObject *> &data ) const
+void TVDaemon::GetPage( const HTTPRequest &request, int &start, int &page_size )
 {
-  int count = data.size( );
-
-  int p = 7;
-  std::sort( data.begin( ), data.end( ), JSONObjectComparator( p ));
-
-  int start = -1;
+  start = -1;
   if( request.HasParam( "start" ))
     request.GetParam( "start", start );
   if( start < 0 )
     start = 0;
-  if( start > count )
-    start = count;
 
-  int page_size = -1;
+  page_size = -1;
   if( request.HasParam( "page_size" ))
     request.GetParam( "page_size", page_size );
   if( page_size <= 0 )
     page_size = 10;
+}
+
+class VectorCursor : public JSONCursor
+{
+  public:
+    VectorCursor( const std::vector<const JSONObject *> &data ) : data(data), i(0) { }
+    virtual const JSONObject *Next( ) { return i < data.size( ) ? data[i++] : NULL; }
+    virtual int Count( ) const { return data.size( ); }
+
+  private:
+    const std::vector<const JSONObject *> &data;
+    size_t i;
+};
+
+void TVDaemon::ServerSideTable( const HTTPRequest &request, std::vector<const JSONObject *> &data, bool sorted ) const
+{
+  std::string json;
+  WriteTable( request, data, json, sorted );
+  request.ReplyJSON( json );
+}
 
+void TVDaemon::WriteTable( const HTTPRequest &request, std::vector<const JSONObject *> &data, std::string &json, bool sorted )
+{
+  int count = data.size( );
+  int start, page_size;
+  GetPage( request, start, page_size );
+  if( start > count )
+    start = count;
   int end = start + page_size;
   if( end > count )
     end = count;
 
-  json_object *h = json_object_new_object( );
-  json_object *a = json_object_new_array();
+  if( !sorted and start < end )
+  {
+    // only the requested page needs to be in order
+    int p = 7;
+    JSONObjectComparator comparator( p );
+    if( start > 0 )
+      std::nth_element( data.begin( ), data.begin( ) + start, data.end( ), comparator );
+    std::partial_sort( data.begin( ) + start, data.begin( ) + end, data.end( ), comparator );
+  }
 
-  for( int i = start; i < end; i++ )
+  VectorCursor cursor( data );
+  WriteTable( request, cursor, json );
+}
+
+void TVDaemon::WriteTable( const HTTPRequest &request, JSONCursor &cursor, std::string &json )
+{
+  int start, page_size;
+  GetPage( request, start, page_size );
+
+  JSONWriter writer( json );
+  writer.BeginObject( );
+  writer.BeginArray( "data" );
+  int count = 0;
+  const JSONObject *o;
+  for( ; count < start and cursor.Next( ); count++ );
+  for( ; count < start + page_size and ( o = cursor.Next( )); count++ )
   {
-    json_object *entry = json_object_new_object( );
-    data[i]->json( entry );
-    json_object_array_add( a, entry );
+    writer.BeginObject( );
+    o->serialize( writer );
+    writer.EndObject( );
   }
-  json_object_object_add( h, "count", json_object_new_int( count ));
-  json_object_object_add( h, "start", json_object_new_int( start ));
-  json_object_object_add( h, "end", json_object_new_int( end ));
-  json_object_object_add( h, "data", a );
-  request.Reply( h );
+  writer.EndArray( );
+  int end = count;
+  if( cursor.Count( ) >= 0 )
+    count = cursor.Count( );
+  else
+    for( ; cursor.Next( ); count++ );
+  if( start > count )
+    start = count;
+  writer.Add( "count", count );
+  writer.Add( "start", start );
+  writer.Add( "end", end );
+  writer.EndObject( );
 }
 
 bool TVDaemon::RPC_Channel( const HTTPRequest &request, const std::string &cat, const std::string &action )
@@ -1200,6 +1274,8 @@ bool TVDaemon::RPC_Channel( const HTTPRequest &request, const std::string &cat,
 
 bool TVDaemon::RPC_Source( const HTTPRequest &request, const std::string &cat, const std::string &action )
 {
+  // locked before the channels, see RemoveChannel( )
+  ScopeLock _l( mutex_sources );
   std::string t;
   if( !request.GetParam( "source_id", t ))
     return false;
@@ -1305,6 +1381,9 @@ Channel *TVDaemon::GetChannel( const std::string &channel_name )
 
 bool TVDaemon::RemoveChannel( int id )
 {
+  // sources before channels, as service RPCs create channels
+  ScopeLock _ls( mutex_sources );
+  SCOPELOCK( );
   std::map<int, Channel *>::iterator it = channels.find( id );
   if( it == channels.end( ))
     return false;
@@ -116,11 +116,15 @@ Thread::~Thread( )
 void Thread::JoinThread( )
 {
   if( started )
+  {
     pthread_join( thread, NULL );
+    started = false;
+  }
 }
 
 bool Thread::StartThread( )
 {
+  JoinThread( ); // reap a previous run
   int ret;
   pthread_attr_t attr;
   pthread_attr_init( &attr );
@@ -134,6 +138,7 @@ bool Thread::StartThread( )
     LogError( "error creating thread: %d", ret );
     return false;
   }
+  started = true;
   pthread_attr_destroy( &attr );
   return true;
 }
@@ -141,9 +146,7 @@ bool Thread::StartThread( )
 void *Thread::run( void *ptr )
 {
   Thread *t = (Thread *) ptr;
-  t->started = true;
   t->Run( );
-  t->started = false;
   pthread_exit( NULL );
   return NULL;
 }
@@ -22,10 +22,12 @@
 #include "Transponder.h"
 
 #include <libdvbv5/dvb-file.h>
+#include <libdvbv5/eit.h>
 #include <RPCObject.h>
 
 #include "Source.h"
 #include "Service.h"
+#include "Channel.h"
 #include "Transponder_DVBS.h"
 #include "Transponder_DVBT.h"
 #include "Transponder_DVBC.h"
@@ -41,10 +43,13 @@ Transponder::Transponder( Source &source, const fe_delivery_system_t delsys, int
   signal(0), noise(0),
   TSID(0),
   enabled(true),
+  probe(false),
   state(State_New),
   last_epg_update(0),
   last_epg_failed(0),
   has_channels(false),
+  collectors(0),
+  tune_cache_port(NULL),
   has_nit(false),
   has_sdt(false),
   has_vct(false),
@@ -57,8 +62,11 @@ Transponder::Transponder( Source &source, const fe_delivery_system_t delsys, int
 Transponder::Transponder( Source &source, std::string configfile ) :
   ConfigObject( source, configfile ),
   source(source),
+  probe(false),
   last_epg_failed(0),
   has_channels(false),
+  collectors(0),
+  tune_cache_port(NULL),
   has_nit(false),
   has_sdt(false),
   has_vct(false),
@@ -160,6 +168,7 @@ bool Transponder::IsSame( const Transponder &transponder, const struct dvb_entry
 
 void Transponder::AddProperty( const struct dtv_property &prop )
 {
+  ClearTuneCache( );
   switch( prop.cmd )
   {
     case DTV_DELIVERY_SYSTEM:
@@ -177,6 +186,7 @@ bool Transponder::SaveConfig( )
   WriteConfig( "Frequency",     (int) frequency );
   WriteConfig( "TSID",          TSID );
   WriteConfig( "Enabled",       enabled );
+  WriteConfig( "Probe",         probe );
   WriteConfig( "State",         state );
   WriteConfig( "Signal",        signal );
   WriteConfig( "Noise",         noise );
@@ -215,6 +225,7 @@ bool Transponder::LoadConfig( )
   ReadConfig( "Frequency",        frequency );
   ReadConfig( "TSID",             TSID );
   ReadConfig( "Enabled",          enabled );
+  ReadConfig( "Probe",            probe );
   ReadConfig( "State",    (int &) state );
   ReadConfig( "Signal",           signal );
   ReadConfig( "Noise",            noise );
@@ -287,7 +298,7 @@ bool Transponder::UpdateService( uint16_t service_id, Service::Type type, std::s
   return true;
 }
 
-bool Transponder::UpdateStream( uint16_t service_id, int id, int type )
+bool Transponder::UpdateStream( uint16_t service_id, int id, int type, const std::string &language )
 {
   std::map<uint16_t, Service *>::iterator it = services.find( service_id );
   if( it == services.end( ))
@@ -295,7 +306,7 @@ bool Transponder::UpdateStream( uint16_t service_id, int id, int type )
     LogError( "Service with id %d not found", service_id );
     return false;
   }
-  it->second->UpdateStream( id, (Stream::Type) type );
+  it->second->UpdateStream( id, (Stream::Type) type, language );
   SetModified( );
   return true;
 }
@@ -314,6 +325,44 @@ bool Transponder::GetParams( struct dvb_v5_fe_parms *params ) const
   return true;
 }
 
+bool Transponder::ApplyTuneCache( const Port *port, struct dvb_v5_fe_parms *params ) const
+{
+  ScopeLock _l( source );
+  if( tune_cache.empty( ) or port != tune_cache_port )
+    return false;
+  for( std::vector<std::pair<uint32_t, uint32_t> >::const_iterator it = tune_cache.begin( ); it != tune_cache.end( ); it++ )
+    dvb_fe_store_parm( params, it->first, it->second );
+  return true;
+}
+
+void Transponder::UpdateTuneCache( const Port *port, struct dvb_v5_fe_parms *params )
+{
+  // what the frontend locked on, including the frequency offset
+  static const uint32_t cmds[] = { DTV_FREQUENCY, DTV_SYMBOL_RATE, DTV_INNER_FEC, DTV_MODULATION,
+                                   DTV_ROLLOFF, DTV_PILOT, DTV_BANDWIDTH_HZ, DTV_CODE_RATE_HP,
+                                   DTV_CODE_RATE_LP, DTV_GUARD_INTERVAL, DTV_TRANSMISSION_MODE,
+                                   DTV_HIERARCHY, DTV_STREAM_ID };
+  if( dvb_fe_get_parms( params ) != 0 )
+    return;
+
+  ScopeLock _l( source );
+  tune_cache.clear( );
+  tune_cache_port = port;
+  for( size_t i = 0; i < sizeof( cmds ) / sizeof( cmds[0] ); i++ )
+  {
+    uint32_t value;
+    if( dvb_fe_retrieve_parm( params, cmds[i], &value ) == 0 ) // only those of the delivery system
+      tune_cache.push_back( std::make_pair( cmds[i], value ));
+  }
+}
+
+void Transponder::ClearTuneCache( )
+{
+  ScopeLock _l( source );
+  tune_cache.clear( );
+  tune_cache_port = NULL;
+}
+
 void Transponder::SetState( State state )
 {
   this->state = state;
@@ -341,6 +390,7 @@ const char *Transponder::GetStateName( State state )
     case State_ScanningFailed: return "Scanning Failed";
     case State_Idle:           return "Idle";
     case State_Duplicate:      return "Duplicate";
+    case State_NoSignal:       return "No Signal";
     case State_Last:           return NULL;
   }
   return NULL;
@@ -363,6 +413,23 @@ void Transponder::json( json_object *entry ) const
   json_object_object_add( entry, "services",  json_object_new_int( services.size( )));
 }
 
+void Transponder::serialize( JSONWriter &writer ) const
+{
+  writer.Add( "name",      toString( ));
+  writer.Add( "id",        GetKey( ));
+  writer.Add( "source_id", source.GetKey( ));
+  writer.Add( "source",    source.GetName( ));
+  writer.Add( "state",     state );
+  writer.Add( "epg_state", epg_state );
+  writer.Add( "enabled",   (int) enabled );
+  writer.Add( "delsys",    delsys );
+  writer.Add( "frequency", (int) frequency );
+  writer.Add( "tsid",      TSID );
+  writer.Add( "signal",    signal );
+  writer.Add( "noise",     noise );
+  writer.Add( "services",  (int) services.size( ));
+}
+
 bool Transponder::RPC( const HTTPRequest &request, const std::string &cat, const std::string &action )
 {
   if( cat == "transponder" )
@@ -477,16 +544,59 @@ void Transponder::UpdateEPG( )
 {
   last_epg_update = 0;
   last_epg_failed = 0;
+  eit_cache.Clear( ); // read everything again
 }
 
-bool Transponder::ReadEPG( const struct dvb_table_eit_event *event )
+int Transponder::AddEITSection( struct dvb_v5_fe_parms *fe, const uint8_t *data, ssize_t len )
 {
+  // present/following and schedule of the actual transport stream
+  uint8_t table_id = data[0];
+  if( table_id != DVB_TABLE_EIT and ( table_id < DVB_TABLE_EIT_SCHEDULE or table_id > DVB_TABLE_EIT_SCHEDULE + 0x0F ))
+    return -1;
+  if( !eit_cache.Changed( data, len ))
+    return -1;
+  struct dvb_table_eit *eit = NULL;
+  dvb_table_eit_init( fe, data, len, &eit );
+  if( !eit )
+    return 0;
+  int count = AddEPG( eit->event, table_id, eit->header.version );
+  dvb_table_eit_free( eit );
+  return count;
+}
+
+int Transponder::GetPopularity( ) const
+{
+  int popularity = 0;
+  for( std::map<uint16_t, Service *>::const_iterator it = services.begin( ); it != services.end( ); it++ )
+  {
+    Channel *channel = it->second->GetChannel( );
+    if( channel )
+      popularity += 1 + channel->GetPopularity( );
+  }
+  return popularity;
+}
+
+void Transponder::SetCollecting( bool collecting )
+{
+  ScopeLock _l( source );
+  collectors += collecting ? 1 : -1;
+}
+
+int Transponder::AddEPG( const struct dvb_table_eit_event *event, uint8_t table_id, uint8_t version )
+{
+  int count = 0;
   for( std::map<uint16_t, Service *>::const_iterator it = services.begin( ); it != services.end( ); it++ )
-    it->second->ReadEPG( event );
+    count += it->second->AddEPG( event, table_id, version );
+  return count;
+}
+
+void Transponder::SaveEPG( )
+{
+  for( std::map<uint16_t, Service *>::const_iterator it = services.begin( ); it != services.end( ); it++ )
+    it->second->SaveEPG( );
   last_epg_update = time( NULL );
   SetEPGState( EPGState_Updated );
-  SaveConfig( );
-  return true;
+  SetModified( );
 }
 
 bool Transponder::compare( const JSONObject &other, const int &p ) const
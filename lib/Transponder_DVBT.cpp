@@ -23,18 +23,60 @@
 
 #include <libdvbv5/dvb-fe.h>
 
-Transponder_DVBT::Transponder_DVBT( Source &source, const fe_delivery_system_t delsys, int config_id ) : Transponder( source, delsys, config_id )
+Transponder_DVBT::Transponder_DVBT( Source &source, const fe_delivery_system_t delsys, int config_id ) : Transponder( source, delsys, config_id ),
+  bandwidth(0),
+  code_rate_HP(FEC_AUTO),
+  code_rate_LP(FEC_AUTO),
+  modulation(QAM_AUTO),
+  transmission_mode(TRANSMISSION_MODE_AUTO),
+  guard_interval(GUARD_INTERVAL_AUTO),
+  hierarchy(HIERARCHY_AUTO),
+  plp_id(0)
 {
   has_sdt = true;
   has_nit = true;
 }
 
-Transponder_DVBT::Transponder_DVBT( Source &source, std::string configfile ) : Transponder( source, configfile )
+Transponder_DVBT::Transponder_DVBT( Source &source, std::string configfile ) : Transponder( source, configfile ),
+  bandwidth(0),
+  code_rate_HP(FEC_AUTO),
+  code_rate_LP(FEC_AUTO),
+  modulation(QAM_AUTO),
+  transmission_mode(TRANSMISSION_MODE_AUTO),
+  guard_interval(GUARD_INTERVAL_AUTO),
+  hierarchy(HIERARCHY_AUTO),
+  plp_id(0)
 {
   has_sdt = true;
   has_nit = true;
 }
 
+Transponder_DVBT::Transponder_DVBT( Source &source,
+		    const fe_delivery_system_t delsys,
+		    uint32_t frequency,
+		    int bandwidth,
+		    fe_code_rate code_rate_HP,
+		    fe_code_rate code_rate_LP,
+		    fe_modulation modulation,
+		    fe_transmit_mode transmission_mode,
+		    fe_guard_interval guard_interval,
+		    fe_hierarchy hierarchy,
+		    int config_id ) :
+  Transponder( source, delsys, config_id ),
+  bandwidth(bandwidth),
+  code_rate_HP(code_rate_HP),
+  code_rate_LP(code_rate_LP),
+  modulation(modulation),
+  transmission_mode(transmission_mode),
+  guard_interval(guard_interval),
+  hierarchy(hierarchy),
+  plp_id(0)
+{
+  this->frequency = frequency;
+  has_sdt = true;
+  has_nit = true;
+}
+
 Transponder_DVBT::~Transponder_DVBT( )
 {
 }
@@ -132,6 +174,11 @@ std::string Transponder_DVBT::toString( ) const
 
 bool Transponder_DVBT::IsSame( const Transponder &t )
 {
+  const Transponder_DVBT &other = (const Transponder_DVBT &) t;
+  if( other.delsys != delsys )
+    return false;
+  if( other.frequency != frequency )
+    return false;
   return true;
 }
 